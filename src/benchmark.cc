@@ -0,0 +1,280 @@
+// Benchmarks of the containers, built without coverage and run by make bench.
+// Each benchmark prints its measurements, so that the numbers can be compared across machines and
+// thread counts.
+// Run ./bench.out <name> to run only the benchmarks whose names contain <name>.
+#include <sched.h>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <utility>
+#include <vector>
+#include "bitstring.h"
+#include "first_touch.h"
+#include "lock.h"
+#include "omp.h"
+#include "omp_hash_map.h"
+#include "omp_hash_set.h"
+
+namespace {
+
+// Return the seconds taken by the function.
+double time_seconds(const std::function<void()>& function) {
+  const auto start = std::chrono::steady_clock::now();
+  function();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Reserving a large map constructs the buckets in parallel, each thread touching its own pages
+// first, so the time shall drop with the number of threads.
+void reserve() {
+  constexpr size_t N_BUCKETS = 20000000;
+  const int n_threads = omp_get_max_threads();
+  for (const int n_reserving_threads : {1, n_threads}) {
+    omp_set_num_threads(n_reserving_threads);
+    omp_hash_map<int, int> m;
+    const double seconds = time_seconds([&]() { m.reserve(N_BUCKETS); });
+    printf("reserve %zu buckets with %d threads: %.3fs\n",
+           m.get_n_buckets(),
+           n_reserving_threads,
+           seconds);
+    if (n_threads == 1) break;
+  }
+  omp_set_num_threads(n_threads);
+}
+
+// Strided lookups over a large map miss the TLB on most accesses with regular pages, and less
+// often with huge pages backing the bucket array.
+void huge_pages() {
+  constexpr int N_KEYS = 10000000;
+  const std::pair<const char*, page_policy> POLICIES[] = {
+      {"normal", page_policy::normal},
+      {"transparent_huge", page_policy::transparent_huge},
+      {"explicit_huge", page_policy::explicit_huge}};
+  for (const auto& policy : POLICIES) {
+    omp_hash_map<int, int> m(policy.second);
+    m.reserve(N_KEYS);
+    const double set_seconds = time_seconds([&]() {
+#pragma omp parallel for
+      for (int i = 0; i < N_KEYS; i++) m.set(i, i);
+    });
+    long long sum = 0;
+    const double get_seconds = time_seconds([&]() {
+#pragma omp parallel for reduction(+ : sum)
+      for (int i = 0; i < N_KEYS; i++) sum += m.get_copy_or_default((i * 7919LL) % N_KEYS, 0);
+    });
+    printf("%s pages: set %d keys %.3fs, strided get %.3fs%s\n",
+           policy.first,
+           N_KEYS,
+           set_seconds,
+           get_seconds,
+           sum == (N_KEYS - 1LL) * N_KEYS / 2 ? "" : " (wrong sum)");
+  }
+}
+
+// An occupation string with 64 of the 256 bits set, derived from the index.
+std::array<uint64_t, 4> get_occupation_words(const long long index) {
+  std::array<uint64_t, 4> words = {};
+  uint64_t state = index * 0x9e3779b97f4a7c15ULL + 1;
+  for (int i = 0; i < 64; i++) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    const size_t bit = state % 256;
+    words[bit / 64] |= 1ULL << (bit % 64);
+  }
+  return words;
+}
+
+// A hasher combining the words one by one, as written by users without a built-in hasher.
+struct user_words_hash {
+  size_t operator()(const std::array<uint64_t, 4>& words) const {
+    size_t seed = 0;
+    for (const uint64_t word : words) {
+      seed ^= std::hash<uint64_t>()(word) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    }
+    return seed;
+  }
+};
+
+// Return the seconds taken to add the keys to a set on one thread and to find them all.
+template <class K, class H>
+double time_add_and_has(const std::vector<K>& keys) {
+  omp_hash_set<K, H> s;
+  size_t n_found = 0;
+  const double seconds = time_seconds([&]() {
+    for (const auto& key : keys) s.add(key);
+    for (const auto& key : keys) n_found += s.has(key);
+  });
+  if (n_found != keys.size()) printf("missing keys\n");
+  return seconds;
+}
+
+// Occupation strings as fixed_bitstring keys, against the same words as std::array keys with a
+// hasher written by hand.
+void bitstring() {
+  constexpr int N_KEYS = 2000000;
+  std::vector<std::array<uint64_t, 4>> words(N_KEYS);
+  std::vector<fixed_bitstring<256>> bitstrings(N_KEYS);
+  for (int i = 0; i < N_KEYS; i++) {
+    words[i] = get_occupation_words(i);
+    bitstrings[i] = fixed_bitstring<256>(words[i]);
+  }
+  const double bitstring_seconds =
+      time_add_and_has<fixed_bitstring<256>, omp_hash<fixed_bitstring<256>>>(bitstrings);
+  const double words_seconds = time_add_and_has<std::array<uint64_t, 4>, user_words_hash>(words);
+  printf("add and has %d 256 bit keys: fixed_bitstring %.3fs, std::array with hash_combine %.3fs\n",
+         N_KEYS,
+         bitstring_seconds,
+         words_seconds);
+}
+
+// A lock next to the locks of the other threads, and a lock on a cache line of its own.
+struct packed_lock {
+  omp_lock lock;
+};
+
+struct alignas(64) padded_lock {
+  omp_lock lock;
+};
+
+// Return the seconds taken by the threads to lock and unlock a lock of their own many times.
+template <class T>
+double time_own_locks(const int n_threads) {
+  constexpr int N_LOCKS_PER_THREAD = 1000000;
+  first_touch_array<T> locks(n_threads);
+  return time_seconds([&]() {
+#pragma omp parallel num_threads(n_threads)
+    {
+      omp_lock& lock = locks[omp_get_thread_num()].lock;
+      for (int i = 0; i < N_LOCKS_PER_THREAD; i++) {
+        lock.lock();
+        lock.unlock();
+      }
+    }
+  });
+}
+
+// Threads taking adjacent packed locks invalidate the cache lines of each other, which padded locks
+// avoid. The threads of a single core never run at the same time, so there the layouts are even.
+void lock_padding() {
+  for (const int n_threads : {1, 8, 32}) {
+    printf("own lock of %d threads: packed %.3fs, padded %.3fs\n",
+           n_threads,
+           time_own_locks<packed_lock>(n_threads),
+           time_own_locks<padded_lock>(n_threads));
+  }
+}
+
+// Sets of distinct keys into a growing map, and updates of a few hot keys, with the lock policy.
+// The updates run on one thread per core, as a ticket lock shared by more threads than cores hands
+// itself to preempted waiters, and every handoff then waits for a context switch. The rehashes run
+// on the OpenMP threads, so OMP_NUM_THREADS shall not exceed the number of cores either.
+template <class L>
+void run_lock_policy(const char* name) {
+  constexpr int N_KEYS = 10000000;
+  constexpr int N_HOT_KEYS = 1000;
+  const int n_threads = omp_get_num_procs();
+  omp_hash_map<int, int, omp_hash<int>, L> m;
+  const double set_seconds = time_seconds([&]() {
+#pragma omp parallel for num_threads(n_threads)
+    for (int i = 0; i < N_KEYS; i++) m.set(i, i);
+  });
+  omp_hash_map<int, int, omp_hash<int>, L> hot_m;
+  const double update_seconds = time_seconds([&]() {
+#pragma omp parallel for num_threads(n_threads)
+    for (int i = 0; i < N_KEYS; i++) hot_m.set(i % N_HOT_KEYS, [](int& value) { value++; }, 0);
+  });
+  printf("%s with %d threads: set %d keys %.3fs, update %d hot keys %.3fs\n",
+         name,
+         n_threads,
+         N_KEYS,
+         set_seconds,
+         N_HOT_KEYS,
+         update_seconds);
+}
+
+void lock_policies() {
+  run_lock_policy<omp_lock>("omp_lock");
+  run_lock_policy<spin_lock>("spin_lock");
+  run_lock_policy<ticket_lock>("ticket_lock");
+  run_lock_policy<futex_lock>("futex_lock");
+}
+
+// Grow a map from its initial buckets to ten million keys, with the threads crossing the max load
+// factor together.
+void growth() {
+  constexpr int N_KEYS = 10000000;
+  for (const int n_threads : {1, 8, 32}) {
+    omp_hash_map<int, int> m;
+    const double seconds = time_seconds([&]() {
+#pragma omp parallel for num_threads(n_threads)
+      for (int i = 0; i < N_KEYS; i++) m.set(i, i);
+    });
+    printf("grow to %d keys with %d threads: %.3fs, %zu buckets\n",
+           N_KEYS,
+           n_threads,
+           seconds,
+           m.get_n_buckets());
+  }
+}
+
+// A global operation, here a reserve which finds the buckets large enough, waits for the updates
+// in flight and holds back new ones, while the other threads keep updating the map.
+void global_operation() {
+  constexpr int N_KEYS = 1000000;
+  constexpr int N_OPERATIONS = 100000;
+  omp_hash_map<int, int> m;
+  m.reserve(N_KEYS);
+  for (const int n_threads : {1, 8, 32}) {
+    int n_started_threads = 0;
+    bool is_done = false;
+    double seconds = 0;
+#pragma omp parallel num_threads(n_threads)
+    {
+      const int thread_id = omp_get_thread_num();
+      if (thread_id == 0) {
+        // The operations start once every other thread is updating.
+        while (__atomic_load_n(&n_started_threads, __ATOMIC_ACQUIRE) < n_threads - 1) sched_yield();
+        seconds = time_seconds([&]() {
+          for (int i = 0; i < N_OPERATIONS; i++) m.reserve(1);
+        });
+        __atomic_store_n(&is_done, true, __ATOMIC_RELEASE);
+      } else {
+        __atomic_add_fetch(&n_started_threads, 1, __ATOMIC_RELEASE);
+        for (int i = thread_id; !__atomic_load_n(&is_done, __ATOMIC_ACQUIRE); i += n_threads) {
+          m.set(i % N_KEYS, [](int& value) { value++; }, 0);
+        }
+      }
+    }
+    printf("global operation among %d threads: %.2fus\n",
+           n_threads,
+           seconds / N_OPERATIONS * 1e6);
+  }
+}
+
+struct benchmark {
+  const char* name;
+  void (*run)();
+};
+
+const benchmark BENCHMARKS[] = {{"reserve", reserve},
+                                {"huge_pages", huge_pages},
+                                {"bitstring", bitstring},
+                                {"lock_padding", lock_padding},
+                                {"lock_policies", lock_policies},
+                                {"growth", growth},
+                                {"global_operation", global_operation}};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  printf("threads: %d\n", omp_get_max_threads());
+  for (const auto& benchmark : BENCHMARKS) {
+    if (argc > 1 && !strstr(benchmark.name, argv[1])) continue;
+    benchmark.run();
+  }
+  return 0;
+}
@@ -0,0 +1,124 @@
+#ifndef BITSTRING_H_
+#define BITSTRING_H_
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include "omp_hash.h"
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace bitstring {
+
+// Hash an array of 64-bit words with the byte hash of omp_hashing, which folds two words per wide
+// multiply. The hash values do not depend on the build flags, so frozen and shared memory maps
+// keyed by bit strings can be read by binaries built differently. The seed is mixed in with the
+// words rather than after them, so keys colliding under one seed are spread under another.
+inline size_t hash_words(const uint64_t* words, const size_t n_words, const uint64_t seed = 0) {
+  return omp_hashing::hash_bytes(words, n_words * sizeof(uint64_t), seed);
+}
+
+// Test if two arrays of 64-bit words are equal, comparing four words per instruction with AVX2.
+inline bool equal_words(const uint64_t* lhs, const uint64_t* rhs, const size_t n_words) {
+  size_t i = 0;
+#ifdef __AVX2__
+  for (; i + 4 <= n_words; i += 4) {
+    const __m256i lhs_words = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lhs + i));
+    const __m256i rhs_words = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rhs + i));
+    const __m256i diff = _mm256_xor_si256(lhs_words, rhs_words);
+    if (!_mm256_testz_si256(diff, diff)) return false;
+  }
+#endif
+  for (; i < n_words; i++) {
+    if (lhs[i] != rhs[i]) return false;
+  }
+  return true;
+}
+
+// A hasher for keys already stored as std::array<uint64_t, N_WORDS>.
+template <size_t N_WORDS>
+struct words_hash {
+  uint64_t seed;
+
+  words_hash() : seed(0) {}
+
+  explicit words_hash(const uint64_t seed) : seed(seed) {}
+
+  size_t operator()(const std::array<uint64_t, N_WORDS>& words) const {
+    return hash_words(words.data(), N_WORDS, seed);
+  }
+};
+
+}  // namespace bitstring
+
+// A bit string of fixed width, such as an occupation string, usable as a hash map or set key.
+// std::hash and omp_hash are specialized with hash_words, and the equality uses AVX2 if available.
+template <size_t N_BITS>
+class fixed_bitstring {
+ public:
+  constexpr static size_t N_WORDS = (N_BITS + 63) / 64;
+
+  fixed_bitstring() : words() {}
+
+  explicit fixed_bitstring(const std::array<uint64_t, N_WORDS>& words) : words(words) {}
+
+  bool get(const size_t i) const { return (words[i / 64] >> (i % 64)) & 1; }
+
+  void set(const size_t i, const bool value = true) {
+    const uint64_t mask = 1ULL << (i % 64);
+    if (value) {
+      words[i / 64] |= mask;
+    } else {
+      words[i / 64] &= ~mask;
+    }
+  }
+
+  // Return the number of set bits.
+  size_t count() const {
+    size_t n_set_bits = 0;
+    for (const uint64_t word : words) n_set_bits += __builtin_popcountll(word);
+    return n_set_bits;
+  }
+
+  const std::array<uint64_t, N_WORDS>& get_words() const { return words; }
+
+  size_t hash(const uint64_t seed = 0) const {
+    return bitstring::hash_words(words.data(), N_WORDS, seed);
+  }
+
+  bool operator==(const fixed_bitstring& other) const {
+    return bitstring::equal_words(words.data(), other.words.data(), N_WORDS);
+  }
+
+  bool operator!=(const fixed_bitstring& other) const { return !(*this == other); }
+
+ private:
+  std::array<uint64_t, N_WORDS> words;
+};
+
+template <size_t N_BITS>
+constexpr size_t fixed_bitstring<N_BITS>::N_WORDS;
+
+namespace std {
+template <size_t N_BITS>
+struct hash<fixed_bitstring<N_BITS>> {
+  size_t operator()(const fixed_bitstring<N_BITS>& bitstring) const { return bitstring.hash(); }
+};
+}  // namespace std
+
+// Seeded by hash_words itself instead of mixing the seed into the std::hash value.
+template <size_t N_BITS>
+struct omp_hash<fixed_bitstring<N_BITS>> {
+  uint64_t seed;
+
+  omp_hash() : seed(0) {}
+
+  explicit omp_hash(const uint64_t seed) : seed(seed) {}
+
+  size_t operator()(const fixed_bitstring<N_BITS>& bitstring) const {
+    return bitstring.hash(seed);
+  }
+};
+
+#endif
@@ -0,0 +1,140 @@
+#include "bitstring.h"
+#include <unordered_set>
+#include "gtest/gtest.h"
+#include "omp.h"
+#include "omp_hash_map.h"
+#include "omp_hash_set.h"
+
+namespace {
+
+// An occupation string with 64 of the 256 bits set, derived from the index.
+std::array<uint64_t, 4> get_occupation_words(const long long index) {
+  std::array<uint64_t, 4> words = {};
+  uint64_t state = index * 0x9e3779b97f4a7c15ULL + 1;
+  for (int i = 0; i < 64; i++) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    const size_t bit = state % 256;
+    words[bit / 64] |= 1ULL << (bit % 64);
+  }
+  return words;
+}
+
+// A hasher combining the words one by one, as written by users without a built-in hasher.
+struct user_words_hash {
+  size_t operator()(const std::array<uint64_t, 4>& words) const {
+    size_t seed = 0;
+    for (const uint64_t word : words) {
+      seed ^= std::hash<uint64_t>()(word) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    }
+    return seed;
+  }
+};
+
+}  // namespace
+
+TEST(BitstringTest, GetSetAndCount) {
+  fixed_bitstring<200> bitstring;
+  EXPECT_EQ(bitstring.N_WORDS, 4);
+  EXPECT_EQ(bitstring.count(), 0);
+  bitstring.set(0);
+  bitstring.set(130);
+  bitstring.set(199);
+  EXPECT_TRUE(bitstring.get(130));
+  EXPECT_FALSE(bitstring.get(131));
+  EXPECT_EQ(bitstring.count(), 3);
+  bitstring.set(130, false);
+  EXPECT_FALSE(bitstring.get(130));
+  EXPECT_EQ(bitstring.count(), 2);
+}
+
+TEST(BitstringTest, HashAndEquality) {
+  fixed_bitstring<320> lhs, rhs;
+  EXPECT_TRUE(lhs == rhs);
+  EXPECT_EQ(lhs.hash(), rhs.hash());
+
+  // Differences in the vectorized words and the remaining word are both detected.
+  lhs.set(100);
+  EXPECT_TRUE(lhs != rhs);
+  rhs.set(100);
+  EXPECT_TRUE(lhs == rhs);
+  lhs.set(300);
+  EXPECT_TRUE(lhs != rhs);
+  EXPECT_NE(lhs.hash(), rhs.hash());
+
+  // Single bit differences spread over the hash values.
+  std::unordered_set<size_t> hash_values;
+  for (size_t i = 0; i < 320; i++) {
+    fixed_bitstring<320> bitstring;
+    bitstring.set(i);
+    hash_values.insert(std::hash<fixed_bitstring<320>>()(bitstring) % 1021);
+  }
+  EXPECT_GT(hash_values.size(), 250);
+}
+
+TEST(BitstringTest, HashIndependentOfBuildFlags) {
+  // The expected value is the byte hash of the words, which has no instruction set specific path.
+  fixed_bitstring<128> bitstring(std::array<uint64_t, 2>{{0x0123456789abcdefULL, 42}});
+  const std::array<uint64_t, 2> words = {{0x0123456789abcdefULL, 42}};
+  EXPECT_EQ(bitstring.hash(), omp_hashing::hash_bytes(words.data(), sizeof(words)));
+  EXPECT_EQ(bitstring.hash(), 0xaad503f0b6213ae9ULL);
+  EXPECT_EQ(std::hash<fixed_bitstring<128>>()(bitstring), bitstring.hash());
+
+  // The seed goes into the word hash, not after it.
+  EXPECT_EQ(omp_hash<fixed_bitstring<128>>(7)(bitstring), bitstring.hash(7));
+  EXPECT_NE(bitstring.hash(7), bitstring.hash());
+  EXPECT_EQ(bitstring::words_hash<2>(7)(words), bitstring.hash(7));
+}
+
+TEST(BitstringTest, HashMapAndSetKeys) {
+  omp_hash_map<fixed_bitstring<256>, int> m;
+  omp_hash_set<std::array<uint64_t, 4>, bitstring::words_hash<4>> s;
+#pragma omp parallel for
+  for (int i = 0; i < 1000; i++) {
+    m.set(fixed_bitstring<256>(get_occupation_words(i)), i);
+    s.add(get_occupation_words(i));
+  }
+  EXPECT_EQ(m.get_n_keys(), 1000);
+  EXPECT_EQ(s.get_n_keys(), 1000);
+  for (int i = 0; i < 1000; i++) {
+    EXPECT_EQ(m.get_copy_or_default(fixed_bitstring<256>(get_occupation_words(i)), -1), i);
+    EXPECT_TRUE(s.has(get_occupation_words(i)));
+  }
+  EXPECT_FALSE(s.has(get_occupation_words(1000)));
+}
+
+TEST(BitstringLargeTest, TenMillionsBitstringKeys) {
+  omp_hash_set<fixed_bitstring<256>> m;
+  constexpr long long LARGE_N_KEYS = 10000000;
+
+  m.reserve(LARGE_N_KEYS);
+#pragma omp parallel for
+  for (long long i = 0; i < LARGE_N_KEYS; i++) {
+    m.add(fixed_bitstring<256>(get_occupation_words(i)));
+  }
+  long long n_found = 0;
+#pragma omp parallel for reduction(+ : n_found)
+  for (long long i = 0; i < LARGE_N_KEYS; i++) {
+    n_found += m.has(fixed_bitstring<256>(get_occupation_words(i)));
+  }
+  EXPECT_EQ(n_found, LARGE_N_KEYS);
+}
+
+TEST(BitstringLargeTest, TenMillionsUserHashedKeys) {
+  // The baseline for TenMillionsBitstringKeys.
+  omp_hash_set<std::array<uint64_t, 4>, user_words_hash> m;
+  constexpr long long LARGE_N_KEYS = 10000000;
+
+  m.reserve(LARGE_N_KEYS);
+#pragma omp parallel for
+  for (long long i = 0; i < LARGE_N_KEYS; i++) {
+    m.add(get_occupation_words(i));
+  }
+  long long n_found = 0;
+#pragma omp parallel for reduction(+ : n_found)
+  for (long long i = 0; i < LARGE_N_KEYS; i++) {
+    n_found += m.has(get_occupation_words(i));
+  }
+  EXPECT_EQ(n_found, LARGE_N_KEYS);
+}
@@ -0,0 +1,106 @@
+#ifndef BLOOM_FILTER_H_
+#define BLOOM_FILTER_H_
+
+#include <cstdint>
+#include "first_touch.h"
+#include "omp.h"
+#include "omp_hash.h"
+
+// A blocked Bloom filter of hash values, safe for concurrent adds and tests.
+// Each hash value sets one bit in each of the 8 words of a cache line sized block, so that both an
+// add and a test touch a single cache line. Bits are only set with atomic or, so a test may miss a
+// concurrent add but never a completed one. Only clear() unsets bits, and concurrent tests during a
+// clear() may return false for the hash values added before it.
+class blocked_bloom_filter {
+ public:
+  // Size the filter for the specified number of keys.
+  explicit blocked_bloom_filter(
+      const size_t n_keys, const page_policy policy = page_policy::normal);
+
+  // Return the number of keys the filter is sized for.
+  size_t get_capacity() const { return capacity; }
+
+  void add(const size_t hash_value);
+
+  // Return false if the hash value has never been added, or true with a small false positive rate.
+  bool may_contain(const size_t hash_value) const;
+
+  // Remove all the hash values.
+  void clear();
+
+ private:
+  constexpr static size_t N_BLOCK_WORDS = 8;
+
+  // The false positive rate is about 0.5% at the capacity.
+  constexpr static size_t N_BITS_PER_KEY = 16;
+
+  // Smaller filters are not worth the cost of a parallel region.
+  constexpr static size_t N_MIN_PARALLEL_BLOCKS = 1 << 14;
+
+  struct alignas(64) block {
+    uint64_t words[N_BLOCK_WORDS];
+    block() : words() {}
+  };
+
+  size_t capacity;
+
+  size_t n_blocks;
+
+  first_touch_array<block> blocks;
+
+  size_t get_block_id(const uint64_t h) const { return ((h >> 32) * n_blocks) >> 32; }
+
+  // Odd multipliers which take different bits of the low half into the bit index of each word.
+  static uint64_t get_word_mask(const uint64_t h, const size_t i) {
+    constexpr uint32_t SALTS[N_BLOCK_WORDS] = {0x47b6137bU,
+                                               0x44974d91U,
+                                               0x8824ad5bU,
+                                               0xa2b7289dU,
+                                               0x705495c7U,
+                                               0x2df1424bU,
+                                               0x9efc4947U,
+                                               0x5c6bfb31U};
+    return 1ULL << ((static_cast<uint32_t>(h) * SALTS[i]) >> 26);
+  }
+};
+
+inline blocked_bloom_filter::blocked_bloom_filter(
+    const size_t n_keys, const page_policy policy)
+    : capacity(n_keys) {
+  constexpr size_t N_BLOCK_BITS = N_BLOCK_WORDS * 64;
+  n_blocks = (n_keys * N_BITS_PER_KEY + N_BLOCK_BITS - 1) / N_BLOCK_BITS;
+  if (n_blocks == 0) n_blocks = 1;
+  blocks = first_touch_array<block>(n_blocks, policy);
+}
+
+// The hash value is remixed, so that weak hashers such as the identity spread over the blocks.
+inline void blocked_bloom_filter::add(const size_t hash_value) {
+  const uint64_t h = omp_hashing::fmix64(hash_value);
+  block& target = blocks[get_block_id(h)];
+  for (size_t i = 0; i < N_BLOCK_WORDS; i++) {
+    // Skip the write when the bit is already set, so that frequent keys do not bounce the line.
+    const uint64_t mask = get_word_mask(h, i);
+    if (!(__atomic_load_n(&target.words[i], __ATOMIC_RELAXED) & mask)) {
+      __atomic_fetch_or(&target.words[i], mask, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+inline bool blocked_bloom_filter::may_contain(const size_t hash_value) const {
+  const uint64_t h = omp_hashing::fmix64(hash_value);
+  const block& target = blocks[get_block_id(h)];
+  uint64_t missing_bits = 0;
+  for (size_t i = 0; i < N_BLOCK_WORDS; i++) {
+    missing_bits |= ~__atomic_load_n(&target.words[i], __ATOMIC_RELAXED) & get_word_mask(h, i);
+  }
+  return missing_bits == 0;
+}
+
+inline void blocked_bloom_filter::clear() {
+#pragma omp parallel for schedule(static) if (n_blocks >= N_MIN_PARALLEL_BLOCKS)
+  for (size_t i = 0; i < n_blocks; i++) {
+    for (uint64_t& word : blocks[i].words) __atomic_store_n(&word, 0, __ATOMIC_RELAXED);
+  }
+}
+
+#endif
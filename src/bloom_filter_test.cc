@@ -0,0 +1,48 @@
+#include "bloom_filter.h"
+#include "gtest/gtest.h"
+#include "omp.h"
+#include "omp_hash.h"
+
+TEST(BloomFilterTest, AddAndMayContain) {
+  constexpr size_t N_KEYS = 100000;
+  blocked_bloom_filter filter(N_KEYS);
+  EXPECT_EQ(filter.get_capacity(), N_KEYS);
+  EXPECT_FALSE(filter.may_contain(0));
+
+  // No false negatives, and a false positive rate around 0.5% at the capacity.
+  const omp_hash<size_t> hasher;
+  for (size_t i = 0; i < N_KEYS; i++) filter.add(hasher(i));
+  size_t n_false_negatives = 0;
+  size_t n_false_positives = 0;
+  for (size_t i = 0; i < N_KEYS; i++) {
+    if (!filter.may_contain(hasher(i))) n_false_negatives++;
+    if (filter.may_contain(hasher(i + N_KEYS))) n_false_positives++;
+  }
+  EXPECT_EQ(n_false_negatives, 0);
+  EXPECT_LT(n_false_positives, N_KEYS / 100);
+
+  filter.clear();
+  for (size_t i = 0; i < N_KEYS; i++) n_false_positives += filter.may_contain(hasher(i)) ? 1 : 0;
+  EXPECT_LT(n_false_positives, N_KEYS / 100);
+}
+
+TEST(BloomFilterTest, WeakHashValues) {
+  // Sequential hash values, such as from the identity hash of integers, still spread.
+  constexpr size_t N_KEYS = 100000;
+  blocked_bloom_filter filter(N_KEYS);
+  for (size_t i = 0; i < N_KEYS; i++) filter.add(i);
+  size_t n_false_positives = 0;
+  for (size_t i = N_KEYS; i < N_KEYS * 2; i++) n_false_positives += filter.may_contain(i) ? 1 : 0;
+  EXPECT_LT(n_false_positives, N_KEYS / 100);
+}
+
+TEST(BloomFilterTest, ConcurrentAdd) {
+  constexpr size_t N_KEYS = 1000000;
+  blocked_bloom_filter filter(N_KEYS);
+#pragma omp parallel for
+  for (size_t i = 0; i < N_KEYS; i++) filter.add(i * 7919);
+  size_t n_false_negatives = 0;
+#pragma omp parallel for reduction(+ : n_false_negatives)
+  for (size_t i = 0; i < N_KEYS; i++) n_false_negatives += filter.may_contain(i * 7919) ? 0 : 1;
+  EXPECT_EQ(n_false_negatives, 0);
+}
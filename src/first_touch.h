@@ -0,0 +1,141 @@
+#ifndef FIRST_TOUCH_H_
+#define FIRST_TOUCH_H_
+
+#include <sys/mman.h>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <utility>
+#include "omp.h"
+
+// The kind of pages backing large arrays.
+enum class page_policy {
+  // Regular pages.
+  normal,
+  // Transparent huge pages requested with madvise().
+  transparent_huge,
+  // Explicit huge pages from the hugetlbfs pool, falling back to transparent huge pages when the
+  // pool is exhausted or not configured.
+  explicit_huge
+};
+
+// A fixed size array which places its pages across NUMA nodes by first touch.
+// The storage is allocated uninitialized and the elements are constructed in a static parallel
+// loop, so with the first touch policy of the operating system, the pages of the i-th chunk of the
+// array land on the NUMA node of the i-th thread, and no thread zeroes the whole array serially.
+// Parallel loops over the array with a static schedule then mostly touch local memory.
+// Large arrays can be backed by 2MB huge pages to reduce TLB misses on random access.
+template <class T>
+class first_touch_array {
+ public:
+  first_touch_array() : n(0), data(nullptr), n_mapped_bytes(0) {}
+
+  explicit first_touch_array(const size_t n, const page_policy policy = page_policy::normal);
+
+  first_touch_array(first_touch_array&& other)
+      : n(other.n), data(other.data), n_mapped_bytes(other.n_mapped_bytes) {
+    other.n = 0;
+    other.data = nullptr;
+    other.n_mapped_bytes = 0;
+  }
+
+  first_touch_array& operator=(first_touch_array&& other) {
+    std::swap(n, other.n);
+    std::swap(data, other.data);
+    std::swap(n_mapped_bytes, other.n_mapped_bytes);
+    other.destroy();
+    return *this;
+  }
+
+  ~first_touch_array() { destroy(); }
+
+  size_t size() const { return n; }
+
+  T& operator[](const size_t i) { return data[i]; }
+
+  const T& operator[](const size_t i) const { return data[i]; }
+
+ private:
+  size_t n;
+
+  T* data;
+
+  // Zero if the storage is from posix_memalign(), otherwise the length of the mmap() mapping.
+  size_t n_mapped_bytes;
+
+  constexpr static size_t PAGE_SIZE = 4096;
+
+  constexpr static size_t HUGE_PAGE_SIZE = 2 << 20;
+
+  // Smaller arrays are not worth the cost of a parallel region.
+  constexpr static size_t N_MIN_PARALLEL_BYTES = 1 << 20;
+
+  // Allocate the uninitialized storage with the pages of the specified policy.
+  void allocate(const page_policy policy);
+
+  // Destruct the elements in parallel and release the storage.
+  void destroy();
+};
+
+template <class T>
+first_touch_array<T>::first_touch_array(const size_t n, const page_policy policy) : n(n) {
+  allocate(policy);
+#pragma omp parallel for schedule(static) if (n * sizeof(T) >= N_MIN_PARALLEL_BYTES)
+  for (size_t i = 0; i < n; i++) {
+    ::new (data + i) T();
+  }
+}
+
+template <class T>
+void first_touch_array<T>::allocate(const page_policy policy) {
+  const size_t n_bytes = n * sizeof(T);
+  n_mapped_bytes = 0;
+  if (policy == page_policy::normal || n_bytes < HUGE_PAGE_SIZE) {
+    void* p = nullptr;
+    if (posix_memalign(&p, PAGE_SIZE, n_bytes) != 0) throw std::bad_alloc();
+    data = static_cast<T*>(p);
+    return;
+  }
+
+  const size_t n_huge_page_bytes = (n_bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+  void* p = MAP_FAILED;
+  if (policy == page_policy::explicit_huge) {
+    const int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+    p = mmap(nullptr, n_huge_page_bytes, PROT_READ | PROT_WRITE, flags, -1, 0);
+  }
+  if (p == MAP_FAILED) {
+    // Over map by one huge page so that the aligned part can be backed by transparent huge pages.
+    const size_t n_aligned_bytes = n_huge_page_bytes + HUGE_PAGE_SIZE;
+    const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    void* mapped = mmap(nullptr, n_aligned_bytes, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (mapped == MAP_FAILED) throw std::bad_alloc();
+    char* unaligned = static_cast<char*>(mapped);
+    const uintptr_t offset = reinterpret_cast<uintptr_t>(unaligned) % HUGE_PAGE_SIZE;
+    char* aligned = offset ? unaligned + (HUGE_PAGE_SIZE - offset) : unaligned;
+    if (aligned > unaligned) munmap(unaligned, aligned - unaligned);
+    munmap(aligned + n_huge_page_bytes, unaligned + n_aligned_bytes - aligned - n_huge_page_bytes);
+    madvise(aligned, n_huge_page_bytes, MADV_HUGEPAGE);
+    p = aligned;
+  }
+  data = static_cast<T*>(p);
+  n_mapped_bytes = n_huge_page_bytes;
+}
+
+template <class T>
+void first_touch_array<T>::destroy() {
+  if (!data) return;
+#pragma omp parallel for schedule(static) if (n * sizeof(T) >= N_MIN_PARALLEL_BYTES)
+  for (size_t i = 0; i < n; i++) {
+    data[i].~T();
+  }
+  if (n_mapped_bytes) {
+    munmap(data, n_mapped_bytes);
+  } else {
+    free(data);
+  }
+  n = 0;
+  data = nullptr;
+  n_mapped_bytes = 0;
+}
+
+#endif
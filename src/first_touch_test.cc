@@ -0,0 +1,40 @@
+#include "first_touch.h"
+#include <cstdint>
+#include <memory>
+#include "gtest/gtest.h"
+#include "omp.h"
+
+TEST(FirstTouchTest, Construction) {
+  // Both below and above the parallel construction threshold.
+  for (const size_t n : {100, 1000000}) {
+    first_touch_array<std::unique_ptr<int>> a(n);
+    EXPECT_EQ(a.size(), n);
+    size_t n_nulls = 0;
+    for (size_t i = 0; i < n; i++) n_nulls += a[i] ? 0 : 1;
+    EXPECT_EQ(n_nulls, n);
+  }
+}
+
+TEST(FirstTouchTest, MoveAndDestruction) {
+  first_touch_array<std::unique_ptr<int>> a(1000000);
+#pragma omp parallel for schedule(static)
+  for (size_t i = 0; i < a.size(); i++) a[i].reset(new int(i));
+  first_touch_array<std::unique_ptr<int>> b(std::move(a));
+  EXPECT_EQ(a.size(), 0);
+  EXPECT_EQ(b.size(), 1000000);
+  EXPECT_EQ(*b[12345], 12345);
+  b = first_touch_array<std::unique_ptr<int>>(10);
+  EXPECT_EQ(b.size(), 10);
+  EXPECT_FALSE(b[9]);
+}
+
+TEST(FirstTouchTest, HugePages) {
+  // Explicit huge pages fall back to transparent huge pages when hugetlbfs has no free pages.
+  for (const auto policy : {page_policy::transparent_huge, page_policy::explicit_huge}) {
+    first_touch_array<std::unique_ptr<int>> a(1000000, policy);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(&a[0]) % (2 << 20), 0);
+    a[999999].reset(new int(5));
+    EXPECT_EQ(*a[999999], 5);
+    EXPECT_FALSE(a[0]);
+  }
+}
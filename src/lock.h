@@ -0,0 +1,183 @@
+#ifndef LOCK_H_
+#define LOCK_H_
+
+#include <linux/futex.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstdint>
+#include "omp.h"
+
+// The lock policies of the segments of omp_hash_map, omp_hash_set and the open addressing
+// containers.
+// A policy is default constructible into the unlocked state and provides lock(), try_lock(), which
+// returns whether it has taken the lock without waiting, and unlock().
+// The critical sections of the containers are a few pointer reads and writes, so the lighter
+// policies save the calls into the OpenMP runtime. The spinning ones waste cycles when there are
+// more threads than cores, where omp_lock or futex_lock shall be used instead.
+
+namespace omp_locking {
+
+// Hint the core that this is a spin wait, which saves power and the pipeline flush on exit.
+inline void pause() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+}  // namespace omp_locking
+
+// The lock of the OpenMP runtime, which is the default.
+class omp_lock {
+ public:
+  omp_lock() { omp_init_lock(&handle); }
+
+  ~omp_lock() { omp_destroy_lock(&handle); }
+
+  omp_lock(const omp_lock&) = delete;
+
+  omp_lock& operator=(const omp_lock&) = delete;
+
+  void lock() { omp_set_lock(&handle); }
+
+  bool try_lock() { return omp_test_lock(&handle) != 0; }
+
+  void unlock() { omp_unset_lock(&handle); }
+
+ private:
+  omp_lock_t handle;
+};
+
+// A test and test and set spin lock.
+// Waiting threads spin on a plain read, which hits their own caches until the lock is released,
+// and back off exponentially so that fewer of them race for the line on release. Beyond the max
+// backoff, they yield the core, so that a preempted holder can run.
+class spin_lock {
+ public:
+  spin_lock() : locked(false) {}
+
+  spin_lock(const spin_lock&) = delete;
+
+  spin_lock& operator=(const spin_lock&) = delete;
+
+  void lock() {
+    size_t n_pauses = 1;
+    while (__atomic_exchange_n(&locked, true, __ATOMIC_ACQUIRE)) {
+      while (__atomic_load_n(&locked, __ATOMIC_RELAXED)) {
+        if (n_pauses > MAX_N_PAUSES) {
+          sched_yield();
+          continue;
+        }
+        for (size_t i = 0; i < n_pauses; i++) omp_locking::pause();
+        n_pauses *= 2;
+      }
+    }
+  }
+
+  bool try_lock() {
+    return !__atomic_load_n(&locked, __ATOMIC_RELAXED) &&
+           !__atomic_exchange_n(&locked, true, __ATOMIC_ACQUIRE);
+  }
+
+  void unlock() { __atomic_store_n(&locked, false, __ATOMIC_RELEASE); }
+
+ private:
+  bool locked;
+
+  constexpr static size_t MAX_N_PAUSES = 1024;
+};
+
+// A ticket lock, which grants the lock in the order of arrival.
+// It bounds the waiting time of each thread under heavy contention, but a preempted waiter also
+// blocks all the waiters behind it. Waiters back off in proportion to their place in the queue.
+class ticket_lock {
+ public:
+  ticket_lock() : next_ticket(0), serving_ticket(0) {}
+
+  ticket_lock(const ticket_lock&) = delete;
+
+  ticket_lock& operator=(const ticket_lock&) = delete;
+
+  void lock() {
+    const uint32_t ticket = __atomic_fetch_add(&next_ticket, 1, __ATOMIC_RELAXED);
+    size_t n_waits = 0;
+    while (true) {
+      const uint32_t serving = __atomic_load_n(&serving_ticket, __ATOMIC_ACQUIRE);
+      if (serving == ticket) return;
+      if (++n_waits > MAX_N_WAITS) {
+        sched_yield();
+        continue;
+      }
+      const size_t n_pauses = static_cast<uint32_t>(ticket - serving) * N_PAUSES_PER_TICKET;
+      for (size_t i = 0; i < n_pauses; i++) omp_locking::pause();
+    }
+  }
+
+  // Take the next ticket only if it is the one being served.
+  bool try_lock() {
+    uint32_t ticket = __atomic_load_n(&serving_ticket, __ATOMIC_RELAXED);
+    return __atomic_compare_exchange_n(
+        &next_ticket, &ticket, ticket + 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+  }
+
+  void unlock() {
+    const uint32_t serving = __atomic_load_n(&serving_ticket, __ATOMIC_RELAXED);
+    __atomic_store_n(&serving_ticket, serving + 1, __ATOMIC_RELEASE);
+  }
+
+ private:
+  uint32_t next_ticket;
+
+  uint32_t serving_ticket;
+
+  constexpr static size_t N_PAUSES_PER_TICKET = 16;
+
+  constexpr static size_t MAX_N_WAITS = 1024;
+};
+
+// A lock which spins for a short while and then sleeps in the kernel on a futex.
+// Uncontended locking and unlocking take one atomic operation each and no system call, as a spin
+// lock, while long waits do not burn the cores. The state is 0 if unlocked, 1 if locked, and 2 if
+// locked with possible sleepers, which unlock() then has to wake.
+class futex_lock {
+ public:
+  futex_lock() : state(0) {}
+
+  futex_lock(const futex_lock&) = delete;
+
+  futex_lock& operator=(const futex_lock&) = delete;
+
+  void lock() {
+    for (size_t i = 0; i < N_SPINS; i++) {
+      uint32_t expected = 0;
+      if (__atomic_load_n(&state, __ATOMIC_RELAXED) == 0 &&
+          __atomic_compare_exchange_n(
+              &state, &expected, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return;
+      }
+      omp_locking::pause();
+    }
+    while (__atomic_exchange_n(&state, 2, __ATOMIC_ACQUIRE) != 0) {
+      syscall(SYS_futex, &state, FUTEX_WAIT_PRIVATE, 2, nullptr, nullptr, 0);
+    }
+  }
+
+  bool try_lock() {
+    uint32_t expected = 0;
+    return __atomic_compare_exchange_n(
+        &state, &expected, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+  }
+
+  void unlock() {
+    if (__atomic_exchange_n(&state, 0, __ATOMIC_RELEASE) == 2) {
+      syscall(SYS_futex, &state, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+    }
+  }
+
+ private:
+  uint32_t state;
+
+  constexpr static size_t N_SPINS = 128;
+};
+
+#endif
@@ -0,0 +1,74 @@
+#include "lock.h"
+#include "gtest/gtest.h"
+#include "omp.h"
+
+namespace {
+
+// Increment a counter under the lock from all the threads, which loses increments without mutual
+// exclusion.
+template <class L>
+long long count_under_lock(const int n_threads, const long long n_increments) {
+  L lock;
+  long long count = 0;
+#pragma omp parallel for num_threads(n_threads)
+  for (long long i = 0; i < n_increments; i++) {
+    lock.lock();
+    count++;
+    lock.unlock();
+  }
+  return count;
+}
+
+// Expect try_lock() to take the lock only if unlocked.
+template <class L>
+void expect_try_lock() {
+  L lock;
+  EXPECT_TRUE(lock.try_lock());
+  EXPECT_FALSE(lock.try_lock());
+  lock.unlock();
+  lock.lock();
+  EXPECT_FALSE(lock.try_lock());
+  lock.unlock();
+  EXPECT_TRUE(lock.try_lock());
+  lock.unlock();
+}
+
+}  // namespace
+
+TEST(LockTest, MutualExclusion) {
+  constexpr long long N_INCREMENTS = 100000;
+  for (const int n_threads : {1, 4}) {
+    EXPECT_EQ(count_under_lock<omp_lock>(n_threads, N_INCREMENTS), N_INCREMENTS);
+    EXPECT_EQ(count_under_lock<spin_lock>(n_threads, N_INCREMENTS), N_INCREMENTS);
+    EXPECT_EQ(count_under_lock<ticket_lock>(n_threads, N_INCREMENTS), N_INCREMENTS);
+    EXPECT_EQ(count_under_lock<futex_lock>(n_threads, N_INCREMENTS), N_INCREMENTS);
+  }
+}
+
+TEST(LockTest, TryLock) {
+  // Not omp_lock, whose test by the thread holding it is unspecified.
+  expect_try_lock<spin_lock>();
+  expect_try_lock<ticket_lock>();
+  expect_try_lock<futex_lock>();
+}
+
+TEST(LockTest, FutexSleep) {
+  // A holder which keeps the lock beyond the spins of the waiter, so that the waiter sleeps.
+  futex_lock lock;
+  int value = 0;
+#pragma omp parallel num_threads(2)
+  {
+    if (omp_get_thread_num() == 0) {
+      lock.lock();
+      usleep(10000);
+      value++;
+      lock.unlock();
+    } else {
+      usleep(1000);
+      lock.lock();
+      value++;
+      lock.unlock();
+    }
+  }
+  EXPECT_EQ(value, 2);
+}
@@ -0,0 +1,609 @@
+#ifndef OMP_CUCKOO_HASH_MAP_H_
+#define OMP_CUCKOO_HASH_MAP_H_
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "first_touch.h"
+#include "lock.h"
+#include "omp.h"
+#include "omp_hash.h"
+#include "open_addressing.h"
+
+// A high performance concurrent hash map based on bucketized cuckoo hashing and OpenMP.
+// Each key lives in one of its two candidate buckets, so a lookup reads at most two buckets
+// regardless of the key distribution. The buckets are guarded by striped segment locks, and an
+// insertion which has to displace other keys runs as a global operation, which has the whole table.
+// K and V must be default constructible. H shall not map more than 8 keys to the same value,
+// otherwise no table size can hold them and set() throws std::length_error, leaving the map as it
+// was.
+// L is the lock policy of the segments, one of those in lock.h.
+template <class K, class V, class H = omp_hash<K>, class L = omp_lock>
+class omp_cuckoo_hash_map {
+ public:
+  // The bucket array can be backed by huge pages to reduce TLB misses on large tables.
+  explicit omp_cuckoo_hash_map(const page_policy policy = page_policy::normal);
+
+  // Set the number of buckets in the container to be at least the specified value.
+  // Throw std::length_error, leaving the map as it was, if no table from that size up to
+  // MAX_N_GROWTHS doublings of it can hold the keys.
+  void reserve(const size_t n_buckets) {
+    const size_t n_rehashing_buckets = omp_open_addressing::get_n_rehashing_buckets(n_buckets);
+    rehash(n_rehashing_buckets);
+  };
+
+  // Return the number of buckets.
+  size_t get_n_buckets() const { return n_buckets; };
+
+  // Return the current load factor (the ratio between the number of keys and slots).
+  double get_load_factor() const {
+    return static_cast<double>(get_n_keys()) / (n_buckets * N_BUCKET_SLOTS);
+  }
+
+  // Return the max load factor beyond which an automatic rehashing will occur.
+  double get_max_load_factor() const { return max_load_factor; }
+
+  // Set the max load factor beyond which an automatic rehashing will occur.
+  void set_max_load_factor(const double max_load_factor) {
+    this->max_load_factor = max_load_factor;
+    is_near_max_load = true;
+  }
+
+  // Return the number of keys.
+  size_t get_n_keys() const { return segments.get_n_keys(); }
+
+  // Set the specified key to the specified value.
+  void set(const K& key, const V& value);
+
+  // Update the value of the specified key.
+  // If the key does not exist, construct it with the default initializer first.
+  void set(const K& key, const std::function<void(V&)>& setter);
+
+  // Update the value of the specified key.
+  // If the key does not exist, construct and set it to the default value passed in first.
+  void set(const K& key, const std::function<void(V&)>& setter, const V& default_value);
+
+  // Remove the specified key.
+  void unset(const K& key);
+
+  // Test if the specified key exists.
+  bool has(const K& key);
+
+  // Return a copy of the value of the specified key, or the default value if key does not exist.
+  V get_copy_or_default(const K& key, const V& default_value);
+
+  // Return the mapped value for the value of the specified key.
+  // If the key does not exist, return the default value.
+  template <class W>
+  W map(const K& key, const std::function<W(const V&)>& mapper, const W& default_value);
+
+  // Return the reduced value of the mapped values of all the keys.
+  // If no key exists, return the default value.
+  template <class W>
+  W map_reduce(
+      const std::function<W(const K&, const V&)>& mapper,
+      const std::function<void(W&, const W&)>& reducer,
+      const W& default_value);
+
+  // Apply the handler to the value of the specific key, if it exists.
+  void apply(const K& key, const std::function<void(const V&)>& handler);
+
+  // Apply the handler to all the keys.
+  void apply(const std::function<void(const K&, const V&)>& handler);
+
+  // Clear all keys.
+  void clear();
+
+ private:
+  size_t n_buckets;
+
+  double max_load_factor;
+
+  // Set once a segment holds its share of the max number of keys, after which every insert checks
+  // the number of keys summed over the segments. Only cleared within a global operation.
+  bool is_near_max_load;
+
+  H hasher;
+
+  page_policy policy;
+
+  constexpr static size_t N_INITIAL_BUCKETS = 11;
+
+  constexpr static size_t N_SEGMENTS_PER_THREAD = 7;
+
+  constexpr static double DEFAULT_MAX_LOAD_FACTOR = 0.9;
+
+  constexpr static size_t N_BUCKET_SLOTS = 4;
+
+  // The keys of the same hash value share their two candidate buckets in any table size.
+  constexpr static size_t MAX_N_KEYS_PER_HASH = 2 * N_BUCKET_SLOTS;
+
+  // The max length of a random walk of displacements before growing the table.
+  constexpr static size_t MAX_N_DISPLACEMENTS = 500;
+
+  // The max number of consecutive growths for placing one entry before giving up.
+  constexpr static size_t MAX_N_GROWTHS = 8;
+
+  // The entire hash map is divided into several segments (depends on how many threads), striped
+  // over the buckets. A key is counted in the segment of its first candidate bucket, which does
+  // not change with displacements.
+  omp_open_addressing::segment_locks<L> segments;
+
+  struct hash_entry {
+    K key;
+    V value;
+  };
+
+  struct hash_bucket {
+    std::array<hash_entry, N_BUCKET_SLOTS> entries;
+    // Bit i is set if entries[i] holds a key.
+    unsigned char occupied;
+    hash_bucket() : occupied(0){};
+  };
+
+  first_touch_array<hash_bucket> buckets;
+
+  // Grow the buckets for the max load factor, unless another thread has already grown them.
+  // A table which fails to grow stays as it is, beyond the max load factor.
+  void rehash_for_load();
+
+  void rehash(const size_t n_rehashing_buckets);
+
+  // Rehash into the specified number of buckets, or into up to MAX_N_GROWTHS doublings of it if
+  // the keys do not fit. Return false, with the table as it was, if none fits.
+  // Must be called within a global operation.
+  bool grow_locked(size_t n_rehashing_buckets);
+
+  // Copy all the entries into a new bucket array of the specified size. Return false, with the old
+  // bucket array kept, if some entry cannot be placed. Must be called within a global operation.
+  bool rehash_locked(const size_t n_rehashing_buckets);
+
+  // Return the two candidate buckets of the specified hash value. They differ if n_buckets > 1.
+  static std::pair<size_t, size_t> get_bucket_ids(const size_t hash_value, const size_t n_buckets);
+
+  // Count a new key in the segment of its first candidate bucket. Return true if the keys of all
+  // the segments shall then be counted against the max load factor.
+  bool count_new_key(const size_t bucket_id_1);
+
+  // Test if the segment holds its share of the max number of keys.
+  bool is_segment_full(const size_t segment_id, const size_t n_segment_keys) const;
+
+  // Set is_near_max_load if any segment holds its share of the max number of keys.
+  // Must be called within a global operation.
+  void update_near_max_load();
+
+  // Lock the two candidate buckets of the key, then apply node_handler to the entry which has the
+  // key, or nullptr if the key does not exist, along with the two buckets.
+  void hash_node_apply(
+      const K& key,
+      const std::function<void(hash_bucket&, hash_bucket&, hash_entry*)>& node_handler);
+
+  // Apply node_handler to all the hash entries.
+  void hash_node_apply(const std::function<void(hash_entry&)>& node_handler);
+
+  // Apply node_handler to the entry of the key, which is inserted with a default value first if
+  // it does not exist. The second argument of node_handler tells whether the key is new.
+  void hash_node_insert_apply(
+      const K& key, const std::function<void(hash_entry&, const bool)>& node_handler);
+
+  static hash_entry* find_entry(hash_bucket& bucket, const K& key);
+
+  // Place the entry in a free slot of the bucket. Return nullptr if the bucket is full.
+  static hash_entry* place_entry(hash_bucket& bucket, hash_entry&& entry);
+
+  // Insert the entry, displacing other entries along a random walk when both candidate buckets are
+  // full. Return false if the walk finds no free slot within MAX_N_DISPLACEMENTS displacements, in
+  // which case the displacements are undone, so that the table and the entry are as they were.
+  // Must be called within a global operation.
+  bool cuckoo_insert(hash_entry& entry);
+
+  // Return the number of keys of the specified hash value. Must be called within a global
+  // operation.
+  size_t count_keys_of_hash(const size_t hash_value);
+};
+
+template <class K, class V, class H, class L>
+omp_cuckoo_hash_map<K, V, H, L>::omp_cuckoo_hash_map(const page_policy policy)
+    : policy(policy), segments(omp_get_max_threads() * N_SEGMENTS_PER_THREAD) {
+  n_buckets = N_INITIAL_BUCKETS;
+  buckets = first_touch_array<hash_bucket>(n_buckets, policy);
+  max_load_factor = DEFAULT_MAX_LOAD_FACTOR;
+  is_near_max_load = false;
+}
+
+template <class K, class V, class H, class L>
+void omp_cuckoo_hash_map<K, V, H, L>::rehash_for_load() {
+  segments.begin_global_operation();
+  try {
+    const size_t n_keys = get_n_keys();
+    if (n_keys >= n_buckets * N_BUCKET_SLOTS * max_load_factor) {
+      grow_locked(omp_open_addressing::get_n_rehashing_buckets(
+          n_keys / (max_load_factor * N_BUCKET_SLOTS) * 2));
+    }
+  } catch (...) {
+    segments.end_global_operation();
+    throw;
+  }
+  segments.end_global_operation();
+}
+
+template <class K, class V, class H, class L>
+void omp_cuckoo_hash_map<K, V, H, L>::rehash(const size_t n_rehashing_buckets) {
+  segments.begin_global_operation();
+  bool is_rehashed;
+  try {
+    // No decrease in the number of buckets.
+    is_rehashed = n_buckets >= n_rehashing_buckets || grow_locked(n_rehashing_buckets);
+  } catch (...) {
+    segments.end_global_operation();
+    throw;
+  }
+  segments.end_global_operation();
+  if (!is_rehashed) throw std::length_error("too many keys with the same hash");
+}
+
+template <class K, class V, class H, class L>
+bool omp_cuckoo_hash_map<K, V, H, L>::grow_locked(size_t n_rehashing_buckets) {
+  for (size_t n_growths = 0; !rehash_locked(n_rehashing_buckets); n_growths++) {
+    if (n_growths == MAX_N_GROWTHS) return false;
+    n_rehashing_buckets = omp_open_addressing::get_n_rehashing_buckets(n_rehashing_buckets * 2);
+  }
+  return true;
+}
+
+template <class K, class V, class H, class L>
+bool omp_cuckoo_hash_map<K, V, H, L>::rehash_locked(const size_t n_rehashing_buckets) {
+  first_touch_array<hash_bucket> rehashing_buckets(n_rehashing_buckets, policy);
+  first_touch_array<hash_bucket> old_buckets = std::move(buckets);
+  const size_t n_old_buckets = n_buckets;
+  buckets = std::move(rehashing_buckets);
+  n_buckets = n_rehashing_buckets;
+  const size_t n_segments = segments.size();
+  segments.reset_n_rehashed_keys();
+
+  // The entries are copied rather than moved, so that the old buckets stay intact until all of
+  // them are placed. Entries with a free slot in a candidate bucket are copied in parallel.
+  // The rest need displacements, which are done serially afterwards.
+  std::vector<std::vector<hash_entry>> thread_pending_entries(omp_get_max_threads());
+#pragma omp parallel for schedule(static)
+  for (size_t i = 0; i < n_old_buckets; i++) {
+    const hash_bucket& old_bucket = old_buckets[i];
+    for (size_t j = 0; j < N_BUCKET_SLOTS; j++) {
+      if (!(old_bucket.occupied & (1 << j))) continue;
+      hash_entry entry = old_bucket.entries[j];
+      const auto& bucket_ids = get_bucket_ids(hasher(entry.key), n_buckets);
+      const size_t segment_id_1 = bucket_ids.first % n_segments;
+      const size_t segment_id_2 = bucket_ids.second % n_segments;
+      segments.lock_rehashing_pair(segment_id_1, segment_id_2);
+      const bool placed = place_entry(buckets[bucket_ids.first], std::move(entry)) ||
+                          place_entry(buckets[bucket_ids.second], std::move(entry));
+      if (placed) segments.add_n_rehashed_keys(segment_id_1);
+      segments.unlock_rehashing_pair(segment_id_1, segment_id_2);
+      if (!placed) thread_pending_entries[omp_get_thread_num()].push_back(std::move(entry));
+    }
+  }
+  for (auto& pending_entries : thread_pending_entries) {
+    for (auto& entry : pending_entries) {
+      const size_t bucket_id_1 = get_bucket_ids(hasher(entry.key), n_buckets).first;
+      if (!cuckoo_insert(entry)) {
+        buckets = std::move(old_buckets);
+        n_buckets = n_old_buckets;
+        return false;
+      }
+      segments.add_n_rehashed_keys(bucket_id_1 % n_segments);
+    }
+  }
+  segments.commit_n_rehashed_keys();
+  update_near_max_load();
+  return true;
+}
+
+template <class K, class V, class H, class L>
+std::pair<size_t, size_t> omp_cuckoo_hash_map<K, V, H, L>::get_bucket_ids(
+    const size_t hash_value, const size_t n_buckets) {
+  // The second hash function remixes the first one, so H is only evaluated once per key.
+  uint64_t alt_hash_value = (hash_value ^ (hash_value >> 32)) * 0x9e3779b97f4a7c15ULL;
+  alt_hash_value ^= alt_hash_value >> 29;
+  const size_t bucket_id_1 = hash_value % n_buckets;
+  size_t bucket_id_2 = alt_hash_value % n_buckets;
+  if (bucket_id_2 == bucket_id_1) bucket_id_2 = (bucket_id_1 + 1) % n_buckets;
+  return std::make_pair(bucket_id_1, bucket_id_2);
+}
+
+template <class K, class V, class H, class L>
+bool omp_cuckoo_hash_map<K, V, H, L>::count_new_key(const size_t bucket_id_1) {
+  const size_t segment_id = bucket_id_1 % segments.size();
+  if (!is_segment_full(segment_id, segments.add_n_keys(segment_id, 1))) return is_near_max_load;
+  is_near_max_load = true;
+  return true;
+}
+
+template <class K, class V, class H, class L>
+bool omp_cuckoo_hash_map<K, V, H, L>::is_segment_full(
+    const size_t, const size_t n_segment_keys) const {
+  // The striped segments hold even shares of the slots.
+  return n_segment_keys * segments.size() >= n_buckets * N_BUCKET_SLOTS * max_load_factor;
+}
+
+template <class K, class V, class H, class L>
+void omp_cuckoo_hash_map<K, V, H, L>::update_near_max_load() {
+  is_near_max_load = false;
+  for (size_t i = 0; i < segments.size(); i++) {
+    if (is_segment_full(i, segments.get_n_keys(i))) is_near_max_load = true;
+  }
+}
+
+template <class K, class V, class H, class L>
+void omp_cuckoo_hash_map<K, V, H, L>::set(const K& key, const V& value) {
+  const auto& node_handler = [&](hash_entry& entry, const bool) { entry.value = value; };
+  hash_node_insert_apply(key, node_handler);
+}
+
+template <class K, class V, class H, class L>
+void omp_cuckoo_hash_map<K, V, H, L>::set(const K& key, const std::function<void(V&)>& setter) {
+  const auto& node_handler = [&](hash_entry& entry, const bool) { setter(entry.value); };
+  hash_node_insert_apply(key, node_handler);
+}
+
+template <class K, class V, class H, class L>
+void omp_cuckoo_hash_map<K, V, H, L>::set(
+    const K& key, const std::function<void(V&)>& setter, const V& default_value) {
+  const auto& node_handler = [&](hash_entry& entry, const bool is_new) {
+    if (is_new) entry.value = default_value;
+    setter(entry.value);
+  };
+  hash_node_insert_apply(key, node_handler);
+}
+
+template <class K, class V, class H, class L>
+void omp_cuckoo_hash_map<K, V, H, L>::unset(const K& key) {
+  const auto& node_handler = [&](hash_bucket& bucket_1, hash_bucket& bucket_2, hash_entry* entry) {
+    if (!entry) return;
+    const hash_entry* bucket_1_begin = &bucket_1.entries[0];
+    const bool in_bucket_1 = entry >= bucket_1_begin && entry < bucket_1_begin + N_BUCKET_SLOTS;
+    hash_bucket& bucket = in_bucket_1 ? bucket_1 : bucket_2;
+    *entry = hash_entry();
+    bucket.occupied &= ~(1 << (entry - &bucket.entries[0]));
+    segments.add_n_keys((&bucket_1 - &buckets[0]) % segments.size(), -1);
+  };
+  hash_node_apply(key, node_handler);
+}
+
+template <class K, class V, class H, class L>
+bool omp_cuckoo_hash_map<K, V, H, L>::has(const K& key) {
+  bool has_key = false;
+  const auto& node_handler = [&](hash_bucket&, hash_bucket&, hash_entry* entry) {
+    if (entry) has_key = true;
+  };
+  hash_node_apply(key, node_handler);
+  return has_key;
+}
+
+template <class K, class V, class H, class L>
+V omp_cuckoo_hash_map<K, V, H, L>::get_copy_or_default(const K& key, const V& default_value) {
+  V value(default_value);
+  const auto& node_handler = [&](hash_bucket&, hash_bucket&, hash_entry* entry) {
+    if (entry) value = entry->value;
+  };
+  hash_node_apply(key, node_handler);
+  return value;
+}
+
+template <class K, class V, class H, class L>
+template <class W>
+W omp_cuckoo_hash_map<K, V, H, L>::map(
+    const K& key, const std::function<W(const V&)>& mapper, const W& default_value) {
+  W mapped_value(default_value);
+  const auto& node_handler = [&](hash_bucket&, hash_bucket&, hash_entry* entry) {
+    if (entry) mapped_value = mapper(entry->value);
+  };
+  hash_node_apply(key, node_handler);
+  return mapped_value;
+}
+
+template <class K, class V, class H, class L>
+template <class W>
+W omp_cuckoo_hash_map<K, V, H, L>::map_reduce(
+    const std::function<W(const K&, const V&)>& mapper,
+    const std::function<void(W&, const W&)>& reducer,
+    const W& default_value) {
+  std::vector<W> thread_reduced_values(omp_get_max_threads(), default_value);
+  W reduced_value = default_value;
+  const auto& node_handler = [&](hash_entry& entry) {
+    const size_t thread_id = omp_get_thread_num();
+    const W& mapped_value = mapper(entry.key, entry.value);
+    reducer(thread_reduced_values[thread_id], mapped_value);
+  };
+  hash_node_apply(node_handler);
+  for (const auto& value : thread_reduced_values) reducer(reduced_value, value);
+  return reduced_value;
+}
+
+template <class K, class V, class H, class L>
+void omp_cuckoo_hash_map<K, V, H, L>::apply(
+    const K& key, const std::function<void(const V&)>& handler) {
+  const auto& node_handler = [&](hash_bucket&, hash_bucket&, hash_entry* entry) {
+    if (entry) handler(entry->value);
+  };
+  hash_node_apply(key, node_handler);
+}
+
+template <class K, class V, class H, class L>
+void omp_cuckoo_hash_map<K, V, H, L>::apply(
+    const std::function<void(const K&, const V&)>& handler) {
+  const auto& node_handler = [&](hash_entry& entry) { handler(entry.key, entry.value); };
+  hash_node_apply(node_handler);
+}
+
+template <class K, class V, class H, class L>
+void omp_cuckoo_hash_map<K, V, H, L>::clear() {
+  first_touch_array<hash_bucket> initial_buckets(N_INITIAL_BUCKETS, policy);
+  segments.begin_global_operation();
+  buckets = std::move(initial_buckets);
+  n_buckets = N_INITIAL_BUCKETS;
+  segments.clear_n_keys();
+  is_near_max_load = false;
+  segments.end_global_operation();
+}
+
+template <class K, class V, class H, class L>
+void omp_cuckoo_hash_map<K, V, H, L>::hash_node_apply(
+    const K& key,
+    const std::function<void(hash_bucket&, hash_bucket&, hash_entry*)>& node_handler) {
+  const size_t hash_value = hasher(key);
+  const size_t n_segments = segments.size();
+  while (true) {
+    // The buckets only change within a global operation.
+    const size_t version = segments.wait_for_global_operation();
+    const auto& bucket_ids = get_bucket_ids(hash_value, n_buckets);
+    const size_t segment_id_1 = bucket_ids.first % n_segments;
+    const size_t segment_id_2 = bucket_ids.second % n_segments;
+    if (!segments.lock_pair(segment_id_1, segment_id_2, version)) continue;
+    hash_bucket& bucket_1 = buckets[bucket_ids.first];
+    hash_bucket& bucket_2 = buckets[bucket_ids.second];
+    hash_entry* entry = find_entry(bucket_1, key);
+    if (!entry) entry = find_entry(bucket_2, key);
+    node_handler(bucket_1, bucket_2, entry);
+    segments.unlock_pair(segment_id_1, segment_id_2);
+    return;
+  }
+}
+
+template <class K, class V, class H, class L>
+void omp_cuckoo_hash_map<K, V, H, L>::hash_node_apply(
+    const std::function<void(hash_entry&)>& node_handler) {
+  segments.begin_global_operation();
+#pragma omp parallel for schedule(static)
+  for (size_t i = 0; i < n_buckets; i++) {
+    hash_bucket& bucket = buckets[i];
+    for (size_t j = 0; j < N_BUCKET_SLOTS; j++) {
+      if (bucket.occupied & (1 << j)) node_handler(bucket.entries[j]);
+    }
+  }
+  segments.end_global_operation();
+}
+
+template <class K, class V, class H, class L>
+void omp_cuckoo_hash_map<K, V, H, L>::hash_node_insert_apply(
+    const K& key, const std::function<void(hash_entry&, const bool)>& node_handler) {
+  // Fast path: the key exists or one of its candidate buckets has a free slot.
+  bool applied = false;
+  bool is_near_full = false;
+  const auto& fast_node_handler = [&](
+      hash_bucket& bucket_1, hash_bucket& bucket_2, hash_entry* entry) {
+    if (entry) {
+      node_handler(*entry, false);
+      applied = true;
+      return;
+    }
+    entry = place_entry(bucket_1, hash_entry{key, V()});
+    if (!entry) entry = place_entry(bucket_2, hash_entry{key, V()});
+    if (!entry) return;
+    is_near_full = count_new_key(&bucket_1 - &buckets[0]);
+    node_handler(*entry, true);
+    applied = true;
+  };
+  hash_node_apply(key, fast_node_handler);
+
+  // Slow path: displace other keys within a global operation.
+  if (!applied) {
+    segments.begin_global_operation();
+    try {
+      const size_t hash_value = hasher(key);
+      auto bucket_ids = get_bucket_ids(hash_value, n_buckets);
+      hash_entry* entry = find_entry(buckets[bucket_ids.first], key);
+      if (!entry) entry = find_entry(buckets[bucket_ids.second], key);
+      const bool is_new = !entry;
+      if (is_new) {
+        hash_entry new_entry{key, V()};
+        for (size_t n_growths = 0; !cuckoo_insert(new_entry); n_growths++) {
+          // No table size helps once the keys of the hash value fill its candidate buckets.
+          if (n_growths == MAX_N_GROWTHS || count_keys_of_hash(hash_value) >= MAX_N_KEYS_PER_HASH ||
+              !grow_locked(omp_open_addressing::get_n_rehashing_buckets(n_buckets * 2))) {
+            throw std::length_error("too many keys with the same hash");
+          }
+        }
+        bucket_ids = get_bucket_ids(hash_value, n_buckets);
+        is_near_full = count_new_key(bucket_ids.first);
+        entry = find_entry(buckets[bucket_ids.first], key);
+        if (!entry) entry = find_entry(buckets[bucket_ids.second], key);
+      }
+      node_handler(*entry, is_new);
+    } catch (...) {
+      segments.end_global_operation();
+      throw;
+    }
+    segments.end_global_operation();
+  }
+  if (is_near_full && get_n_keys() >= n_buckets * N_BUCKET_SLOTS * max_load_factor) {
+    rehash_for_load();
+  }
+}
+
+template <class K, class V, class H, class L>
+typename omp_cuckoo_hash_map<K, V, H, L>::hash_entry* omp_cuckoo_hash_map<K, V, H, L>::find_entry(
+    hash_bucket& bucket, const K& key) {
+  for (size_t i = 0; i < N_BUCKET_SLOTS; i++) {
+    if ((bucket.occupied & (1 << i)) && bucket.entries[i].key == key) return &bucket.entries[i];
+  }
+  return nullptr;
+}
+
+template <class K, class V, class H, class L>
+typename omp_cuckoo_hash_map<K, V, H, L>::hash_entry* omp_cuckoo_hash_map<K, V, H, L>::place_entry(
+    hash_bucket& bucket, hash_entry&& entry) {
+  for (size_t i = 0; i < N_BUCKET_SLOTS; i++) {
+    if (bucket.occupied & (1 << i)) continue;
+    bucket.entries[i] = std::move(entry);
+    bucket.occupied |= 1 << i;
+    return &bucket.entries[i];
+  }
+  return nullptr;
+}
+
+template <class K, class V, class H, class L>
+bool omp_cuckoo_hash_map<K, V, H, L>::cuckoo_insert(hash_entry& entry) {
+  // The slots of the victims, in the order of their evictions.
+  std::vector<hash_entry*> victim_slots;
+  uint64_t random_state = hasher(entry.key) | 1;
+  auto bucket_ids = get_bucket_ids(hasher(entry.key), n_buckets);
+  size_t bucket_id = bucket_ids.first;
+  for (size_t i = 0; i < MAX_N_DISPLACEMENTS; i++) {
+    if (place_entry(buckets[bucket_ids.first], std::move(entry))) return true;
+    if (place_entry(buckets[bucket_ids.second], std::move(entry))) return true;
+
+    // Evict a pseudo random victim and move it to its other candidate bucket next.
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    hash_entry& victim = buckets[bucket_id].entries[random_state % N_BUCKET_SLOTS];
+    std::swap(victim, entry);
+    victim_slots.push_back(&victim);
+    bucket_ids = get_bucket_ids(hasher(entry.key), n_buckets);
+    bucket_id = bucket_ids.first == bucket_id ? bucket_ids.second : bucket_ids.first;
+    bucket_ids = std::make_pair(bucket_id, bucket_id);
+  }
+
+  // Swapping back in the reverse order returns each victim to its slot, and the last one swapped
+  // out is the entry itself.
+  for (size_t i = victim_slots.size(); i > 0; i--) std::swap(*victim_slots[i - 1], entry);
+  return false;
+}
+
+template <class K, class V, class H, class L>
+size_t omp_cuckoo_hash_map<K, V, H, L>::count_keys_of_hash(const size_t hash_value) {
+  const auto& bucket_ids = get_bucket_ids(hash_value, n_buckets);
+  size_t n_keys = 0;
+  for (const size_t bucket_id : {bucket_ids.first, bucket_ids.second}) {
+    const hash_bucket& bucket = buckets[bucket_id];
+    for (size_t i = 0; i < N_BUCKET_SLOTS; i++) {
+      if ((bucket.occupied & (1 << i)) && hasher(bucket.entries[i].key) == hash_value) n_keys++;
+    }
+  }
+  return n_keys;
+}
+
+#endif
@@ -0,0 +1,180 @@
+#include "omp_cuckoo_hash_map.h"
+#include "gtest/gtest.h"
+#include "omp.h"
+#include "reducer.h"
+
+namespace {
+
+// Every four keys share a hash value, so full buckets are common at high load factors.
+struct coarse_hasher {
+  size_t operator()(const int key) const { return key / 4; }
+};
+
+// Maps every key to the same value, which no table size can hold more than 8 keys of.
+struct constant_hasher {
+  size_t operator()(const int) const { return 0; }
+};
+
+// Hashes as omp_hash while is_constant is false, and as constant_hasher otherwise, so that a test
+// can make the keys of a map collide in any larger table.
+struct switchable_hasher {
+  static bool is_constant;
+  size_t operator()(const int key) const { return is_constant ? 0 : omp_hash<int>()(key); }
+};
+
+bool switchable_hasher::is_constant = false;
+
+}  // namespace
+
+TEST(OMPCuckooHashMapTest, SetAndUnset) {
+  omp_cuckoo_hash_map<std::string, int> m;
+  EXPECT_EQ(m.get_n_keys(), 0);
+  m.set("aa", 0);
+  m.set("aa", 1);
+  EXPECT_EQ(m.get_copy_or_default("aa", 0), 1);
+  const auto& increase_by_one = [&](auto& value) { value++; };
+  m.set("aa", increase_by_one);
+  EXPECT_EQ(m.get_copy_or_default("aa", 0), 2);
+  m.set("bbb", increase_by_one, 5);
+  EXPECT_EQ(m.get_copy_or_default("bbb", 0), 6);
+  EXPECT_EQ(m.get_n_keys(), 2);
+
+  m.unset("aa");
+  m.unset("not_exist_key");
+  EXPECT_FALSE(m.has("aa"));
+  EXPECT_TRUE(m.has("bbb"));
+  EXPECT_EQ(m.get_n_keys(), 1);
+}
+
+TEST(OMPCuckooHashMapTest, Reserve) {
+  omp_cuckoo_hash_map<int, int> m;
+  m.reserve(10);
+  EXPECT_GE(m.get_n_buckets(), 10);
+  for (int i = 0; i < 1000; i++) {
+    m.set(i, i * i);
+    EXPECT_EQ(m.get_n_keys(), i + 1);
+    EXPECT_LE(m.get_load_factor(), m.get_max_load_factor());
+  }
+  for (int i = 0; i < 1000; i++) EXPECT_EQ(m.get_copy_or_default(i, 0), i * i);
+}
+
+TEST(OMPCuckooHashMapTest, Displacements) {
+  omp_cuckoo_hash_map<int, int, coarse_hasher> m;
+  m.set_max_load_factor(0.95);
+  for (int i = 0; i < 1000; i++) m.set(i, i);
+  EXPECT_EQ(m.get_n_keys(), 1000);
+  for (int i = 0; i < 1000; i += 3) m.unset(i);
+  EXPECT_EQ(m.get_n_keys(), 666);
+  for (int i = 0; i < 1000; i++) {
+    EXPECT_EQ(m.get_copy_or_default(i, -1), i % 3 != 0 ? i : -1);
+  }
+}
+
+TEST(OMPCuckooHashMapTest, FailedDisplacementsKeepVictims) {
+  // The ninth key walks through the eight keys of its buckets and gives up without growing the
+  // table, with every displaced key back in place.
+  omp_cuckoo_hash_map<int, int, constant_hasher> m;
+  for (int i = 0; i < 8; i++) m.set(i, i * 10);
+  const size_t n_buckets = m.get_n_buckets();
+  EXPECT_THROW(m.set(8, 80), std::length_error);
+  EXPECT_EQ(m.get_n_buckets(), n_buckets);
+  EXPECT_EQ(m.get_n_keys(), 8);
+  EXPECT_FALSE(m.has(8));
+  for (int i = 0; i < 8; i++) EXPECT_EQ(m.get_copy_or_default(i, -1), i * 10);
+
+  // The locks are released, so the map takes further updates.
+  m.unset(0);
+  m.set(8, 80);
+  EXPECT_EQ(m.get_copy_or_default(8, -1), 80);
+  EXPECT_EQ(m.get_n_keys(), 8);
+}
+
+TEST(OMPCuckooHashMapTest, FailedRehashKeepsMap) {
+  omp_cuckoo_hash_map<int, int, switchable_hasher> m;
+  for (int i = 0; i < 100; i++) m.set(i, i);
+  const size_t n_buckets = m.get_n_buckets();
+
+  // No larger table holds 100 keys of one hash value, so the rehash restores the old buckets.
+  switchable_hasher::is_constant = true;
+  EXPECT_THROW(m.reserve(n_buckets * 4), std::length_error);
+  switchable_hasher::is_constant = false;
+  EXPECT_EQ(m.get_n_buckets(), n_buckets);
+  EXPECT_EQ(m.get_n_keys(), 100);
+  for (int i = 0; i < 100; i++) EXPECT_EQ(m.get_copy_or_default(i, -1), i);
+  m.reserve(n_buckets * 4);
+  EXPECT_GE(m.get_n_buckets(), n_buckets * 4);
+  for (int i = 0; i < 100; i++) EXPECT_EQ(m.get_copy_or_default(i, -1), i);
+}
+
+TEST(OMPCuckooHashMapTest, MapReduceAndApply) {
+  omp_cuckoo_hash_map<int, int> m;
+#pragma omp parallel for
+  for (int i = 0; i < 1000; i++) m.set(i, i);
+  EXPECT_EQ(m.get_n_keys(), 1000);
+  EXPECT_EQ(m.map<int>(5, [](const int value) { return value * 2; }, 0), 10);
+  const auto& get_value = [](const int key, const int value) {
+    (void)key;
+    return value;
+  };
+  EXPECT_EQ(m.map_reduce<int>(get_value, reducer::sum<int>, 0), 499500);
+  int sum = 0;
+  m.apply(5, [&](const int value) { sum += value; });
+  m.apply([&](const int key, const int value) {
+    (void)key;
+#pragma omp atomic
+    sum += value;
+  });
+  EXPECT_EQ(sum, 499505);
+
+  m.clear();
+  EXPECT_EQ(m.get_n_keys(), 0);
+  EXPECT_FALSE(m.has(5));
+}
+
+namespace {
+
+// Concurrent inserts, updates and removals of colliding keys, with more threads than at the
+// construction, so that the displacements and the rehashes run as global operations among them.
+template <class L>
+void update_concurrently() {
+  omp_cuckoo_hash_map<int, int, coarse_hasher, L> m;
+  const int n_threads = omp_get_max_threads();
+  omp_set_num_threads(n_threads * 4);
+#pragma omp parallel for
+  for (int i = 0; i < 100000; i++) {
+    m.set(i, i);
+    m.set(i, [](int& value) { value++; });
+    if (i % 2 == 0) m.unset(i);
+  }
+  omp_set_num_threads(n_threads);
+  EXPECT_EQ(m.get_n_keys(), 50000);
+  EXPECT_LE(m.get_load_factor(), m.get_max_load_factor());
+  const auto& mapper = [](const int, const int value) { return value; };
+  EXPECT_EQ(m.template map_reduce<long long>(mapper, reducer::sum<long long>, 0), 2500050000LL);
+}
+
+}  // namespace
+
+TEST(OMPCuckooHashMapTest, ConcurrentUpdates) { update_concurrently<omp_lock>(); }
+
+TEST(OMPCuckooHashMapTest, ConcurrentUpdatesWithSpinLock) { update_concurrently<spin_lock>(); }
+
+TEST(OMPCuckooHashMapTest, ConcurrentUpdatesWithFutexLock) { update_concurrently<futex_lock>(); }
+
+TEST(OMPCuckooHashMapLargeTest, TenMillionsGet) {
+  omp_cuckoo_hash_map<int, int> m;
+  constexpr int LARGE_N_KEYS = 10000000;
+
+  omp_set_nested(1);  // Parallel rehashing.
+#pragma omp parallel for
+  for (int i = 0; i < LARGE_N_KEYS; i++) {
+    m.set(i, i);
+  }
+  EXPECT_EQ(m.get_n_keys(), LARGE_N_KEYS);
+  long long sum = 0;
+#pragma omp parallel for reduction(+ : sum)
+  for (int i = 0; i < LARGE_N_KEYS; i++) {
+    sum += m.get_copy_or_default((i * 7919LL) % LARGE_N_KEYS, 0);
+  }
+  EXPECT_EQ(sum, (LARGE_N_KEYS - 1LL) * LARGE_N_KEYS / 2);
+}
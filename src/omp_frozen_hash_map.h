@@ -0,0 +1,189 @@
+#ifndef OMP_FROZEN_HASH_MAP_H_
+#define OMP_FROZEN_HASH_MAP_H_
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "omp.h"
+#include "omp_hash.h"
+
+// A read-only hash map backed by a memory mapped file written by omp_hash_map::freeze().
+// The file holds a pointer-free open-addressed table, so opening it needs no deserialization,
+// and lookups need no locks. Processes mapping the same file share it through the page cache.
+template <class K, class V, class H = omp_hash<K>>
+class omp_frozen_hash_map {
+  static_assert(std::is_trivially_copyable<K>::value, "K must be trivially copyable");
+  static_assert(std::is_trivially_copyable<V>::value, "V must be trivially copyable");
+
+ public:
+  struct frozen_header {
+    uint64_t magic;
+    uint64_t n_keys;
+    uint64_t n_slots;
+    uint64_t slot_size;
+  };
+
+  struct frozen_slot {
+    K key;
+    V value;
+    unsigned char filled;
+  };
+
+  constexpr static uint64_t MAGIC = 0x70616d6873616866;  // "fhashmap".
+
+  // Return the number of slots to use for the specified number of keys (load factor <= 0.5).
+  static size_t get_n_slots(const size_t n_keys) { return n_keys * 2 + 1; }
+
+  explicit omp_frozen_hash_map(const std::string& filename);
+
+  omp_frozen_hash_map(const omp_frozen_hash_map&) = delete;
+
+  omp_frozen_hash_map& operator=(const omp_frozen_hash_map&) = delete;
+
+  ~omp_frozen_hash_map();
+
+  // Return the number of slots.
+  size_t get_n_slots() const { return n_slots; }
+
+  // Return the number of keys.
+  size_t get_n_keys() const { return n_keys; }
+
+  // Test if the specified key exists.
+  bool has(const K& key) const { return find(key) != nullptr; }
+
+  // Return a copy of the value of the specified key, or the default value if key does not exist.
+  V get_copy_or_default(const K& key, const V& default_value) const;
+
+  // Return the mapped value for the value of the specified key.
+  // If the key does not exist, return the default value.
+  template <class W>
+  W map(const K& key, const std::function<W(const V&)>& mapper, const W& default_value) const;
+
+  // Return the reduced value of the mapped values of all the keys.
+  // If no key exists, return the default value.
+  template <class W>
+  W map_reduce(
+      const std::function<W(const K&, const V&)>& mapper,
+      const std::function<void(W&, const W&)>& reducer,
+      const W& default_value) const;
+
+  // Apply the handler to all the keys.
+  void apply(const std::function<void(const K&, const V&)>& handler) const;
+
+ private:
+  size_t n_keys;
+
+  size_t n_slots;
+
+  size_t n_mapped_bytes;
+
+  void* mapped;
+
+  const frozen_slot* slots;
+
+  H hasher;
+
+  // Return the slot which has the specified key, or nullptr if the key does not exist.
+  const frozen_slot* find(const K& key) const;
+};
+
+template <class K, class V, class H>
+omp_frozen_hash_map<K, V, H>::omp_frozen_hash_map(const std::string& filename) {
+  const int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) throw std::runtime_error("cannot open " + filename);
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 ||
+      static_cast<size_t>(file_stat.st_size) < sizeof(frozen_header)) {
+    close(fd);
+    throw std::runtime_error("invalid frozen hash map file " + filename);
+  }
+  n_mapped_bytes = file_stat.st_size;
+  mapped = mmap(nullptr, n_mapped_bytes, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) throw std::runtime_error("cannot mmap " + filename);
+
+  // A lookup needs at least one empty slot to stop at, and the slots shall fill the file exactly.
+  const frozen_header* header = static_cast<const frozen_header*>(mapped);
+  const size_t n_slot_bytes = n_mapped_bytes - sizeof(frozen_header);
+  if (header->magic != MAGIC || header->slot_size != sizeof(frozen_slot) ||
+      header->n_slots == 0 || header->n_keys >= header->n_slots ||
+      n_slot_bytes % sizeof(frozen_slot) != 0 ||
+      header->n_slots != n_slot_bytes / sizeof(frozen_slot)) {
+    munmap(mapped, n_mapped_bytes);
+    throw std::runtime_error("invalid frozen hash map file " + filename);
+  }
+  n_keys = header->n_keys;
+  n_slots = header->n_slots;
+  slots = reinterpret_cast<const frozen_slot*>(
+      static_cast<const char*>(mapped) + sizeof(frozen_header));
+}
+
+template <class K, class V, class H>
+omp_frozen_hash_map<K, V, H>::~omp_frozen_hash_map() {
+  munmap(mapped, n_mapped_bytes);
+}
+
+template <class K, class V, class H>
+V omp_frozen_hash_map<K, V, H>::get_copy_or_default(const K& key, const V& default_value) const {
+  const frozen_slot* slot = find(key);
+  return slot ? slot->value : default_value;
+}
+
+template <class K, class V, class H>
+template <class W>
+W omp_frozen_hash_map<K, V, H>::map(
+    const K& key, const std::function<W(const V&)>& mapper, const W& default_value) const {
+  const frozen_slot* slot = find(key);
+  return slot ? mapper(slot->value) : default_value;
+}
+
+template <class K, class V, class H>
+template <class W>
+W omp_frozen_hash_map<K, V, H>::map_reduce(
+    const std::function<W(const K&, const V&)>& mapper,
+    const std::function<void(W&, const W&)>& reducer,
+    const W& default_value) const {
+  std::vector<W> thread_reduced_values(omp_get_max_threads(), default_value);
+  W reduced_value = default_value;
+#pragma omp parallel for schedule(static)
+  for (size_t i = 0; i < n_slots; i++) {
+    if (!slots[i].filled) continue;
+    const size_t thread_id = omp_get_thread_num();
+    const W& mapped_value = mapper(slots[i].key, slots[i].value);
+    reducer(thread_reduced_values[thread_id], mapped_value);
+  }
+  for (const auto& value : thread_reduced_values) reducer(reduced_value, value);
+  return reduced_value;
+}
+
+template <class K, class V, class H>
+void omp_frozen_hash_map<K, V, H>::apply(
+    const std::function<void(const K&, const V&)>& handler) const {
+#pragma omp parallel for schedule(static)
+  for (size_t i = 0; i < n_slots; i++) {
+    if (slots[i].filled) handler(slots[i].key, slots[i].value);
+  }
+}
+
+template <class K, class V, class H>
+const typename omp_frozen_hash_map<K, V, H>::frozen_slot* omp_frozen_hash_map<K, V, H>::find(
+    const K& key) const {
+  // Linear probing. The load factor is at most 0.5, so there is always an empty slot in a file
+  // written by freeze(). The probe is still bounded, as the header does not prove it.
+  size_t slot_id = hasher(key) % n_slots;
+  for (size_t n_probes = 0; n_probes < n_slots && slots[slot_id].filled; n_probes++) {
+    if (slots[slot_id].key == key) return &slots[slot_id];
+    slot_id++;
+    if (slot_id == n_slots) slot_id = 0;
+  }
+  return nullptr;
+}
+
+#endif
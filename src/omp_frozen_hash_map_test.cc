@@ -0,0 +1,137 @@
+#include "omp_frozen_hash_map.h"
+#include <cstdio>
+#include "gtest/gtest.h"
+#include "omp.h"
+#include "omp_hash_map.h"
+#include "reducer.h"
+
+TEST(OMPFrozenHashMapTest, Freeze) {
+  omp_hash_map<int, double> m;
+  for (int i = 0; i < 100; i++) m.set(i, i * 0.5);
+  m.freeze("omp_frozen_hash_map_test.bin");
+
+  omp_frozen_hash_map<int, double> frozen("omp_frozen_hash_map_test.bin");
+  EXPECT_EQ(frozen.get_n_keys(), 100);
+  EXPECT_GE(frozen.get_n_slots(), 200);
+  for (int i = 0; i < 100; i++) {
+    EXPECT_TRUE(frozen.has(i));
+    EXPECT_EQ(frozen.get_copy_or_default(i, -1.0), i * 0.5);
+  }
+  EXPECT_FALSE(frozen.has(100));
+  EXPECT_EQ(frozen.get_copy_or_default(-1, -1.0), -1.0);
+  remove("omp_frozen_hash_map_test.bin");
+}
+
+TEST(OMPFrozenHashMapTest, FreezeEmpty) {
+  omp_hash_map<int, int> m;
+  m.freeze("omp_frozen_hash_map_test_empty.bin");
+  omp_frozen_hash_map<int, int> frozen("omp_frozen_hash_map_test_empty.bin");
+  EXPECT_EQ(frozen.get_n_keys(), 0);
+  EXPECT_FALSE(frozen.has(0));
+  remove("omp_frozen_hash_map_test_empty.bin");
+}
+
+TEST(OMPFrozenHashMapTest, InvalidFile) {
+  EXPECT_THROW((omp_frozen_hash_map<int, int>("not_exist_file.bin")), std::runtime_error);
+
+  // Opening with a different slot layout shall be rejected.
+  omp_hash_map<int, int> m;
+  m.set(1, 1);
+  m.freeze("omp_frozen_hash_map_test_invalid.bin");
+  EXPECT_THROW(
+      (omp_frozen_hash_map<int, double>("omp_frozen_hash_map_test_invalid.bin")),
+      std::runtime_error);
+
+  // A header without slots would leave lookups nowhere to stop.
+  using frozen_map = omp_frozen_hash_map<int, int>;
+  const frozen_map::frozen_header header = {
+      frozen_map::MAGIC, 0, 0, sizeof(frozen_map::frozen_slot)};
+  FILE* file = fopen("omp_frozen_hash_map_test_invalid.bin", "wb");
+  fwrite(&header, sizeof(header), 1, file);
+  fclose(file);
+  EXPECT_THROW(frozen_map("omp_frozen_hash_map_test_invalid.bin"), std::runtime_error);
+  remove("omp_frozen_hash_map_test_invalid.bin");
+}
+
+TEST(OMPFrozenHashMapTest, AllSlotsFilled) {
+  // A hand-written file without an empty slot shall not make lookups of missing keys spin.
+  using frozen_map = omp_frozen_hash_map<int, int>;
+  const frozen_map::frozen_header header = {
+      frozen_map::MAGIC, 0, 3, sizeof(frozen_map::frozen_slot)};
+  frozen_map::frozen_slot slots[3] = {};
+  for (int i = 0; i < 3; i++) {
+    slots[i].key = i + 1;
+    slots[i].value = (i + 1) * 10;
+    slots[i].filled = 1;
+  }
+  FILE* file = fopen("omp_frozen_hash_map_test_filled.bin", "wb");
+  fwrite(&header, sizeof(header), 1, file);
+  fwrite(slots, sizeof(slots[0]), 3, file);
+  fclose(file);
+  const frozen_map frozen("omp_frozen_hash_map_test_filled.bin");
+  EXPECT_EQ(frozen.get_copy_or_default(2, 0), 20);
+  EXPECT_FALSE(frozen.has(4));
+  remove("omp_frozen_hash_map_test_filled.bin");
+}
+
+TEST(OMPFrozenHashMapTest, Refreeze) {
+  // Freezing over a mapped file replaces it, and the mapped table stays intact.
+  omp_hash_map<int, int> m;
+  m.set(1, 1);
+  m.freeze("omp_frozen_hash_map_test_refreeze.bin");
+  const omp_frozen_hash_map<int, int> frozen("omp_frozen_hash_map_test_refreeze.bin");
+  m.set(1, 2);
+  m.set(2, 2);
+  m.freeze("omp_frozen_hash_map_test_refreeze.bin");
+  EXPECT_EQ(frozen.get_n_keys(), 1);
+  EXPECT_EQ(frozen.get_copy_or_default(1, 0), 1);
+  const omp_frozen_hash_map<int, int> refrozen("omp_frozen_hash_map_test_refreeze.bin");
+  EXPECT_EQ(refrozen.get_n_keys(), 2);
+  EXPECT_EQ(refrozen.get_copy_or_default(1, 0), 2);
+  remove("omp_frozen_hash_map_test_refreeze.bin");
+}
+
+TEST(OMPFrozenHashMapTest, MapAndMapReduce) {
+  omp_hash_map<int, int> m;
+  for (int i = 0; i < 100; i++) m.set(i, i);
+  m.freeze("omp_frozen_hash_map_test_reduce.bin");
+
+  const omp_frozen_hash_map<int, int> frozen("omp_frozen_hash_map_test_reduce.bin");
+  const auto& square = [&](const int value) { return value * value; };
+  EXPECT_EQ(frozen.map<int>(5, square, 0), 25);
+  EXPECT_EQ(frozen.map<int>(-5, square, 3), 3);
+  const auto& get_value = [](const int key, const int value) {
+    (void)key;
+    return value;
+  };
+  EXPECT_EQ(frozen.map_reduce<int>(get_value, reducer::sum<int>, 0), 4950);
+  int sum = 0;
+  frozen.apply([&](const int key, const int value) {
+    (void)key;
+#pragma omp atomic
+    sum += value;
+  });
+  EXPECT_EQ(sum, 4950);
+  remove("omp_frozen_hash_map_test_reduce.bin");
+}
+
+TEST(OMPFrozenHashMapLargeTest, TenMillionsFreeze) {
+  omp_hash_map<int, int> m;
+  constexpr int LARGE_N_KEYS = 10000000;
+
+  m.reserve(LARGE_N_KEYS);
+#pragma omp parallel for
+  for (int i = 0; i < LARGE_N_KEYS; i++) {
+    m.set(i, i);
+  }
+  m.freeze("omp_frozen_hash_map_test_large.bin");
+  const omp_frozen_hash_map<int, int> frozen("omp_frozen_hash_map_test_large.bin");
+  EXPECT_EQ(frozen.get_n_keys(), LARGE_N_KEYS);
+  bool all_found = true;
+#pragma omp parallel for reduction(&& : all_found)
+  for (int i = 0; i < LARGE_N_KEYS; i++) {
+    all_found = all_found && frozen.get_copy_or_default(i, -1) == i;
+  }
+  EXPECT_TRUE(all_found);
+  remove("omp_frozen_hash_map_test_large.bin");
+}
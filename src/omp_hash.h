@@ -0,0 +1,266 @@
+#ifndef OMP_HASH_H_
+#define OMP_HASH_H_
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+namespace omp_hashing {
+
+// The 64-bit finalizer of MurmurHash3. It is a bijection in which every input bit affects every
+// output bit, so sequential or strided integers spread evenly over any number of buckets.
+inline uint64_t fmix64(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+#if defined(__AVX512F__) && defined(__AVX512DQ__)
+// The masked forms with all the lanes selected, since the unmasked ones of GCC 12 pass an undefined
+// source register, which -Wmaybe-uninitialized reports at every use.
+constexpr __mmask8 ALL_LANES_512 = 0xff;
+
+inline __m512i xorshift_512(const __m512i h) {
+  return _mm512_xor_si512(h, _mm512_maskz_srli_epi64(ALL_LANES_512, h, 33));
+}
+
+inline __m512i fmix64_512(__m512i h) {
+  h = xorshift_512(h);
+  h = _mm512_mullo_epi64(h, _mm512_set1_epi64(static_cast<long long>(0xff51afd7ed558ccdULL)));
+  h = xorshift_512(h);
+  h = _mm512_mullo_epi64(h, _mm512_set1_epi64(static_cast<long long>(0xc4ceb9fe1a85ec53ULL)));
+  return xorshift_512(h);
+}
+
+// Load 8 integer keys of 4 or 8 bytes, widened to 64 bits as static_cast<uint64_t> does.
+template <class K>
+inline __m512i load_keys_512(const K* keys) {
+  if (sizeof(K) == 8) return _mm512_maskz_loadu_epi64(ALL_LANES_512, keys);
+  const __m256i keys_32 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys));
+  return std::is_signed<K>::value ? _mm512_maskz_cvtepi32_epi64(ALL_LANES_512, keys_32)
+                                  : _mm512_maskz_cvtepu32_epi64(ALL_LANES_512, keys_32);
+}
+#elif defined(__AVX2__)
+// AVX2 has no 64-bit multiply, so the low 64 bits are assembled from three 32-bit multiplies.
+inline __m256i mullo_epi64_256(const __m256i a, const uint64_t b) {
+  const __m256i b_lo = _mm256_set1_epi64x(static_cast<long long>(b & 0xffffffffULL));
+  const __m256i b_hi = _mm256_set1_epi64x(static_cast<long long>(b >> 32));
+  const __m256i cross = _mm256_add_epi64(
+      _mm256_mul_epu32(_mm256_srli_epi64(a, 32), b_lo), _mm256_mul_epu32(a, b_hi));
+  return _mm256_add_epi64(_mm256_mul_epu32(a, b_lo), _mm256_slli_epi64(cross, 32));
+}
+
+inline __m256i fmix64_256(__m256i h) {
+  h = _mm256_xor_si256(h, _mm256_srli_epi64(h, 33));
+  h = mullo_epi64_256(h, 0xff51afd7ed558ccdULL);
+  h = _mm256_xor_si256(h, _mm256_srli_epi64(h, 33));
+  h = mullo_epi64_256(h, 0xc4ceb9fe1a85ec53ULL);
+  return _mm256_xor_si256(h, _mm256_srli_epi64(h, 33));
+}
+
+// Load 4 integer keys of 4 or 8 bytes, widened to 64 bits as static_cast<uint64_t> does.
+template <class K>
+inline __m256i load_keys_256(const K* keys) {
+  if (sizeof(K) == 8) return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys));
+  const __m128i keys_32 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys));
+  return std::is_signed<K>::value ? _mm256_cvtepi32_epi64(keys_32) : _mm256_cvtepu32_epi64(keys_32);
+}
+#endif
+
+// Write fmix64(key ^ seed) of n integer keys into the hash values, which may alias the keys.
+// Keys of 4 or 8 bytes are mixed 8 at a time with AVX-512, or 4 at a time with AVX2.
+template <class K>
+inline void fmix64_batch(const K* keys, const size_t n, const uint64_t seed, size_t* hash_values) {
+  size_t i = 0;
+  if (std::is_integral<K>::value && (sizeof(K) == 8 || sizeof(K) == 4)) {
+#if defined(__AVX512F__) && defined(__AVX512DQ__)
+    const __m512i seeds = _mm512_set1_epi64(static_cast<long long>(seed));
+    for (; i + 8 <= n; i += 8) {
+      const __m512i h = fmix64_512(_mm512_xor_si512(load_keys_512(keys + i), seeds));
+      _mm512_storeu_si512(hash_values + i, h);
+    }
+#elif defined(__AVX2__)
+    const __m256i seeds = _mm256_set1_epi64x(static_cast<long long>(seed));
+    for (; i + 4 <= n; i += 4) {
+      const __m256i h = fmix64_256(_mm256_xor_si256(load_keys_256(keys + i), seeds));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(hash_values + i), h);
+    }
+#endif
+  }
+  for (; i < n; i++) hash_values[i] = fmix64(static_cast<uint64_t>(keys[i]) ^ seed);
+}
+
+// Multiply two 64-bit values into 128 bits and fold the halves.
+inline uint64_t mum(const uint64_t a, const uint64_t b) {
+  const unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+  return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+}
+
+inline uint64_t read_8(const unsigned char* p) {
+  uint64_t value;
+  memcpy(&value, p, 8);
+  return value;
+}
+
+inline uint64_t read_4(const unsigned char* p) {
+  uint32_t value;
+  memcpy(&value, p, 4);
+  return value;
+}
+
+// Hash a byte range in the style of wyhash: 16 bytes are folded per wide multiply, and long inputs
+// are folded by three independent lanes.
+inline uint64_t hash_bytes(const void* data, const size_t n_bytes, uint64_t seed = 0) {
+  constexpr uint64_t SECRET_0 = 0xa0761d6478bd642fULL;
+  constexpr uint64_t SECRET_1 = 0xe7037ed1a0b428dbULL;
+  constexpr uint64_t SECRET_2 = 0x8ebc6af09c88c6e3ULL;
+  constexpr uint64_t SECRET_3 = 0x589965cc75374cc3ULL;
+  const unsigned char* p = static_cast<const unsigned char*>(data);
+  seed ^= mum(seed ^ SECRET_0, SECRET_1);
+  uint64_t a, b;
+  if (n_bytes <= 16) {
+    if (n_bytes >= 4) {
+      // Two possibly overlapping 4 byte reads from each end cover all the bytes.
+      const size_t shift = (n_bytes >> 3) << 2;
+      a = (read_4(p) << 32) | read_4(p + shift);
+      b = (read_4(p + n_bytes - 4) << 32) | read_4(p + n_bytes - 4 - shift);
+    } else if (n_bytes > 0) {
+      a = (static_cast<uint64_t>(p[0]) << 16) | (static_cast<uint64_t>(p[n_bytes >> 1]) << 8) |
+          p[n_bytes - 1];
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    size_t n_remaining_bytes = n_bytes;
+    if (n_remaining_bytes > 48) {
+      uint64_t seed_1 = seed, seed_2 = seed;
+      do {
+        seed = mum(read_8(p) ^ SECRET_1, read_8(p + 8) ^ seed);
+        seed_1 = mum(read_8(p + 16) ^ SECRET_2, read_8(p + 24) ^ seed_1);
+        seed_2 = mum(read_8(p + 32) ^ SECRET_3, read_8(p + 40) ^ seed_2);
+        p += 48;
+        n_remaining_bytes -= 48;
+      } while (n_remaining_bytes > 48);
+      seed ^= seed_1 ^ seed_2;
+    }
+    while (n_remaining_bytes > 16) {
+      seed = mum(read_8(p) ^ SECRET_1, read_8(p + 8) ^ seed);
+      p += 16;
+      n_remaining_bytes -= 16;
+    }
+    // The last 16 bytes, which may overlap with the folded ones.
+    a = read_8(p + n_remaining_bytes - 16);
+    b = read_8(p + n_remaining_bytes - 8);
+  }
+  return mum(SECRET_1 ^ n_bytes, mum(a ^ SECRET_1, b ^ seed));
+}
+
+// Construct a hasher with the seed if it is constructible from a seed, otherwise by default.
+template <class H>
+typename std::enable_if<std::is_constructible<H, uint64_t>::value, H>::type make_hasher(
+    const uint64_t seed) {
+  return H(seed);
+}
+
+template <class H>
+typename std::enable_if<!std::is_constructible<H, uint64_t>::value, H>::type make_hasher(
+    const uint64_t) {
+  return H();
+}
+
+// Test if H provides hash_batch(keys, n, hash_values) for keys of type K.
+template <class H, class K, class Enable = void>
+struct has_hash_batch : std::false_type {};
+
+template <class H, class K>
+struct has_hash_batch<
+    H,
+    K,
+    decltype(std::declval<const H&>().hash_batch(
+                 std::declval<const K*>(), size_t(), std::declval<size_t*>()),
+             void())> : std::true_type {};
+
+// Hash n keys with H::hash_batch if H provides it, otherwise with one call of H per key.
+template <class H, class K>
+typename std::enable_if<has_hash_batch<H, K>::value>::type hash_batch(
+    const H& hasher, const K* keys, const size_t n, size_t* hash_values) {
+  hasher.hash_batch(keys, n, hash_values);
+}
+
+template <class H, class K>
+typename std::enable_if<!has_hash_batch<H, K>::value>::type hash_batch(
+    const H& hasher, const K* keys, const size_t n, size_t* hash_values) {
+  for (size_t i = 0; i < n; i++) hash_values[i] = hasher(keys[i]);
+}
+
+}  // namespace omp_hashing
+
+// The default hasher of all the containers.
+// Unlike std::hash of libstdc++, which maps integers to themselves, every bit of the key affects
+// every bit of the hash value, so structured keys spread evenly even over power of two tables.
+// Other key types are hashed with std::hash and then mixed.
+// hash_batch gives the same hash values as calling the hasher on each key, with the mixing of
+// integer keys vectorized. The containers use it for their batch operations.
+// A nonzero seed keys the hash values, so that the keys colliding under one seed are spread under
+// another. It is not a cryptographic keyed hash, and keys colliding in std::hash stay colliding.
+template <class K, class Enable = void>
+struct omp_hash {
+  uint64_t seed;
+
+  omp_hash() : seed(0) {}
+
+  explicit omp_hash(const uint64_t seed) : seed(seed) {}
+
+  size_t operator()(const K& key) const {
+    return omp_hashing::fmix64(std::hash<K>()(key) ^ seed);
+  }
+
+  void hash_batch(const K* keys, const size_t n, size_t* hash_values) const {
+    omp_hashing::hash_batch(std::hash<K>(), keys, n, hash_values);
+    omp_hashing::fmix64_batch(hash_values, n, seed, hash_values);
+  }
+};
+
+template <class K>
+struct omp_hash<
+    K,
+    typename std::enable_if<std::is_integral<K>::value || std::is_enum<K>::value>::type> {
+  uint64_t seed;
+
+  omp_hash() : seed(0) {}
+
+  explicit omp_hash(const uint64_t seed) : seed(seed) {}
+
+  size_t operator()(const K key) const {
+    return omp_hashing::fmix64(static_cast<uint64_t>(key) ^ seed);
+  }
+
+  void hash_batch(const K* keys, const size_t n, size_t* hash_values) const {
+    omp_hashing::fmix64_batch(keys, n, seed, hash_values);
+  }
+};
+
+template <>
+struct omp_hash<std::string> {
+  uint64_t seed;
+
+  omp_hash() : seed(0) {}
+
+  explicit omp_hash(const uint64_t seed) : seed(seed) {}
+
+  size_t operator()(const std::string& key) const {
+    return omp_hashing::hash_bytes(key.data(), key.size(), seed);
+  }
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include "omp_hash_map.h"
+#include <unistd.h>
 #include "gtest/gtest.h"
 #include "omp.h"
 #include "reducer.h"
@@ -34,6 +35,24 @@ TEST(OMPHashMapTest, OneMillionReserve) {
   EXPECT_GE(n_buckets, LARGE_N_BUCKETS);
 }
 
+// AddressSanitizer aborts on allocations beyond its max size instead of failing them.
+#ifndef __SANITIZE_ADDRESS__
+TEST(OMPHashMapTest, FailedReserve) {
+  // The buckets of the reserve exceed the address space, so the allocation fails, and the map is
+  // left as it was and still takes updates.
+  omp_hash_map<int, int> m;
+  for (int i = 0; i < 100; i++) m.set(i, i);
+  const size_t n_buckets = m.get_n_buckets();
+  EXPECT_THROW(m.reserve(1000000000000000ULL), std::bad_alloc);
+  EXPECT_EQ(m.get_n_buckets(), n_buckets);
+  EXPECT_EQ(m.get_n_keys(), 100);
+  for (int i = 0; i < 200; i++) m.set(i, i);
+  for (int i = 0; i < 200; i++) EXPECT_EQ(m.get_copy_or_default(i, -1), i);
+  m.clear();
+  EXPECT_EQ(m.get_n_keys(), 0);
+}
+#endif
+
 TEST(OMPHashMapLargeTest, HundredMillionsReserve) {
   omp_hash_map<std::string, int> m;
   constexpr size_t LARGE_N_BUCKETS = 100000000;
@@ -42,6 +61,15 @@ TEST(OMPHashMapLargeTest, HundredMillionsReserve) {
   EXPECT_GE(n_buckets, LARGE_N_BUCKETS);
 }
 
+TEST(OMPHashMapLargeTest, BillionReserve) {
+  // The buckets are constructed in parallel, so the time scales with the number of threads.
+  omp_hash_map<std::string, int> m;
+  constexpr size_t LARGE_N_BUCKETS = 1000000000;
+  m.reserve(LARGE_N_BUCKETS);
+  const size_t n_buckets = m.get_n_buckets();
+  EXPECT_GE(n_buckets, LARGE_N_BUCKETS);
+}
+
 TEST(OMPHashMapTest, Set) {
   omp_hash_map<std::string, int> m;
   // Set with value.
@@ -78,6 +106,461 @@ TEST(OMPHashMapLargeTest, TenMillionsInsertWithAutoRehash) {
   EXPECT_GE(m.get_n_buckets(), LARGE_N_KEYS);
 }
 
+TEST(OMPHashMapLargeTest, TenMillionsConcurrentGrowth) {
+  // Many threads cross the max load factor at once while growing from the initial buckets, and
+  // only one of them shall rehash, with the others helping it.
+  omp_hash_map<int, int> m;
+  constexpr int LARGE_N_KEYS = 10000000;
+#pragma omp parallel for num_threads(32)
+  for (int i = 0; i < LARGE_N_KEYS; i++) m.set(i, i);
+  EXPECT_EQ(m.get_n_keys(), LARGE_N_KEYS);
+  EXPECT_GE(m.get_n_buckets(), LARGE_N_KEYS);
+}
+
+TEST(OMPHashMapTest, HugePages) {
+  omp_hash_map<int, int> m(page_policy::transparent_huge);
+  m.reserve(1000000);
+  for (int i = 0; i < 1000; i++) m.set(i, i);
+  EXPECT_EQ(m.get_copy_or_default(999, 0), 999);
+  m.clear();
+  EXPECT_EQ(m.get_n_keys(), 0);
+}
+
+TEST(OMPHashMapLargeTest, TenMillionsGet) {
+  omp_hash_map<int, int> m;
+  constexpr int LARGE_N_KEYS = 10000000;
+
+  m.reserve(LARGE_N_KEYS);
+#pragma omp parallel for
+  for (int i = 0; i < LARGE_N_KEYS; i++) {
+    m.set(i, i);
+  }
+  long long sum = 0;
+#pragma omp parallel for reduction(+ : sum)
+  for (int i = 0; i < LARGE_N_KEYS; i++) {
+    sum += m.get_copy_or_default((i * 7919LL) % LARGE_N_KEYS, 0);
+  }
+  EXPECT_EQ(sum, (LARGE_N_KEYS - 1LL) * LARGE_N_KEYS / 2);
+}
+
+TEST(OMPHashMapLargeTest, TenMillionsGetWithHugePages) {
+  omp_hash_map<int, int> m(page_policy::transparent_huge);
+  constexpr int LARGE_N_KEYS = 10000000;
+
+  m.reserve(LARGE_N_KEYS);
+#pragma omp parallel for
+  for (int i = 0; i < LARGE_N_KEYS; i++) {
+    m.set(i, i);
+  }
+  long long sum = 0;
+#pragma omp parallel for reduction(+ : sum)
+  for (int i = 0; i < LARGE_N_KEYS; i++) {
+    sum += m.get_copy_or_default((i * 7919LL) % LARGE_N_KEYS, 0);
+  }
+  EXPECT_EQ(sum, (LARGE_N_KEYS - 1LL) * LARGE_N_KEYS / 2);
+}
+
+TEST(OMPHashMapTest, ConcurrentKeyCounts) {
+  // The keys are counted per segment, and the sum stays exact with the max load factor kept.
+  omp_hash_map<int, int> m;
+  constexpr int N_KEYS = 100000;
+#pragma omp parallel for
+  for (int i = 0; i < N_KEYS; i++) {
+    m.set(i, i);
+    m.set(i, i + 1);
+    if (i % 3 == 0) m.unset(i);
+  }
+  EXPECT_EQ(m.get_n_keys(), N_KEYS - (N_KEYS + 2) / 3);
+  EXPECT_LE(m.get_load_factor(), m.get_max_load_factor());
+
+  m.set_max_load_factor(0.5);
+  m.set(-1, 0);
+  EXPECT_LE(m.get_load_factor(), 0.5);
+  m.clear();
+  EXPECT_EQ(m.get_n_keys(), 0);
+}
+
+namespace {
+
+// Many threads updating a few keys, so that most updates contend on the locks of the segments.
+template <class L>
+void update_under_contention(const int n_threads) {
+  constexpr int N_KEYS = 1000;
+  constexpr int N_UPDATES = 10000000;
+  const int n_max_threads = omp_get_max_threads();
+  omp_set_num_threads(n_threads);
+  omp_hash_map<int, int, omp_hash<int>, L> m;
+  const auto& increment = [](int& value) { value++; };
+#pragma omp parallel for schedule(static, 1)
+  for (int i = 0; i < N_UPDATES; i++) m.set(i % N_KEYS, increment);
+  omp_set_num_threads(n_max_threads);
+  long long sum = 0;
+  for (int i = 0; i < N_KEYS; i++) sum += m.get_copy_or_default(i, 0);
+  EXPECT_EQ(sum, N_UPDATES);
+}
+
+// Ten million sets of distinct keys, which mostly take uncontended locks.
+template <class L>
+void set_ten_millions() {
+  omp_hash_map<int, int, omp_hash<int>, L> m;
+  constexpr int LARGE_N_KEYS = 10000000;
+  m.reserve(LARGE_N_KEYS);
+#pragma omp parallel for
+  for (int i = 0; i < LARGE_N_KEYS; i++) m.set(i, i);
+  EXPECT_EQ(m.get_n_keys(), LARGE_N_KEYS);
+}
+
+}  // namespace
+
+TEST(OMPHashMapLargeTest, SegmentLockContention) { update_under_contention<omp_lock>(32); }
+
+TEST(OMPHashMapLargeTest, SegmentLockContentionWithSpinLock) {
+  update_under_contention<spin_lock>(omp_get_num_procs());
+}
+
+TEST(OMPHashMapLargeTest, SegmentLockContentionWithTicketLock) {
+  update_under_contention<ticket_lock>(omp_get_num_procs());
+}
+
+TEST(OMPHashMapLargeTest, SegmentLockContentionWithFutexLock) {
+  update_under_contention<futex_lock>(32);
+}
+
+TEST(OMPHashMapLargeTest, TenMillionsSetWithOMPLock) { set_ten_millions<omp_lock>(); }
+
+TEST(OMPHashMapLargeTest, TenMillionsSetWithSpinLock) { set_ten_millions<spin_lock>(); }
+
+TEST(OMPHashMapLargeTest, TenMillionsSetWithTicketLock) { set_ten_millions<ticket_lock>(); }
+
+TEST(OMPHashMapLargeTest, TenMillionsSetWithFutexLock) { set_ten_millions<futex_lock>(); }
+
+TEST(OMPHashMapTest, Segments) {
+  EXPECT_THROW((omp_hash_map<int, int>(0)), std::invalid_argument);
+
+  // A single segment serializes all the updates, which are still all applied.
+  omp_hash_map<int, int> m(1);
+  EXPECT_EQ(m.get_n_segments(), 1);
+#pragma omp parallel for
+  for (int i = 0; i < 10000; i++) m.set(i, i);
+  EXPECT_EQ(m.get_n_keys(), 10000);
+  m.reserve(1 << 20);
+  EXPECT_EQ(m.get_n_segments(), 1);
+
+  // A map constructed before raising the number of threads grows its segments on rehashing.
+  const int n_max_threads = omp_get_max_threads();
+  omp_set_num_threads(1);
+  omp_hash_map<int, int> m2;
+  omp_set_num_threads(4);
+  m2.set_segment_growth(true);
+  EXPECT_EQ(m2.get_n_segments(), 7);
+  m2.reserve(100);
+  EXPECT_EQ(m2.get_n_segments(), 28);
+  omp_set_num_threads(n_max_threads);
+
+  // Segments also grow with the buckets, while other threads insert.
+  omp_hash_map<int, int> m3(1);
+  m3.set_segment_growth(true);
+#pragma omp parallel for
+  for (int i = 0; i < 1000000; i++) m3.set(i, i);
+  EXPECT_GE(m3.get_n_segments(), m3.get_n_buckets() / 4096);
+  EXPECT_EQ(m3.get_n_keys(), 1000000);
+  for (int i = 0; i < 1000000; i++) ASSERT_EQ(m3.get_copy_or_default(i, -1), i);
+}
+
+TEST(OMPHashMapTest, RehashWithinParallelRegion) {
+  // Without nesting, the rehashes triggered by the inserts run on the rehashing thread and the
+  // threads helping it, while the other threads keep inserting and reading.
+  const int max_active_levels = omp_get_max_active_levels();
+  omp_set_max_active_levels(1);
+  omp_hash_map<int, int, omp_hash<int>, spin_lock> m;
+  m.set_segment_growth(true);
+#pragma omp parallel for num_threads(8)
+  for (int i = 0; i < 500000; i++) {
+    m.set(i, i);
+    EXPECT_EQ(m.get_copy_or_default(i, -1), i);
+  }
+  omp_set_max_active_levels(max_active_levels);
+  EXPECT_EQ(m.get_n_keys(), 500000);
+  for (int i = 0; i < 500000; i++) ASSERT_EQ(m.get_copy_or_default(i, -1), i);
+}
+
+TEST(OMPHashMapTest, TraversalWaitsForUpdateInFlight) {
+  // The traversal starts while the update holds its segment, and still sees the updated value.
+  omp_hash_map<int, int> m;
+  for (int i = 0; i < 1000; i++) m.set(i, 0);
+  bool is_updating = false;
+  int sum = 0;
+#pragma omp parallel num_threads(2)
+  {
+    if (omp_get_thread_num() == 0) {
+      m.set(500, [&](int& value) {
+        __atomic_store_n(&is_updating, true, __ATOMIC_RELEASE);
+        usleep(100000);
+        value = 1;
+      });
+    } else {
+      while (!__atomic_load_n(&is_updating, __ATOMIC_ACQUIRE)) sched_yield();
+      sum = m.map_reduce<int>(
+          [](const int&, const int& value) { return value; },
+          [](int& total, const int& value) { total += value; },
+          0);
+    }
+  }
+  EXPECT_EQ(sum, 1);
+}
+
+TEST(OMPHashMapTest, GlobalOperationsDuringUpdates) {
+  // Each traversal sees a consistent state, so with inserts only, the counts never decrease.
+  omp_hash_map<int, int> m;
+  constexpr int N_KEYS = 200000;
+  std::vector<int> n_traversed_keys;
+  const auto& mapper = [](const int&, const int&) { return 1; };
+  const auto& reducer = [](int& sum, const int& value) { sum += value; };
+#pragma omp parallel num_threads(4)
+  {
+    if (omp_get_thread_num() == 0) {
+      for (int i = 0; i < 20; i++) {
+        n_traversed_keys.push_back(m.map_reduce<int>(mapper, reducer, 0));
+        m.reserve(m.get_n_buckets() + 1);
+      }
+    } else {
+      for (int i = omp_get_thread_num() - 1; i < N_KEYS; i += omp_get_num_threads() - 1) {
+        m.set(i, i);
+      }
+    }
+  }
+  for (size_t i = 1; i < n_traversed_keys.size(); i++) {
+    EXPECT_LE(n_traversed_keys[i - 1], n_traversed_keys[i]);
+  }
+  EXPECT_EQ(m.map_reduce<int>(mapper, reducer, 0), N_KEYS);
+  EXPECT_EQ(m.get_n_keys(), N_KEYS);
+}
+
+TEST(OMPHashMapTest, WeaklyConsistentTraversal) {
+  // The keys present during the whole traversal are each visited once, and the keys inserted
+  // meanwhile at most once.
+  omp_hash_map<int, int> m;
+  m.set_weakly_consistent_traversal(true);
+  constexpr int N_KEYS = 100000;
+  for (int i = 0; i < N_KEYS; i++) m.set(i, i);
+  const auto& mapper = [](const int& key, const int&) { return key < N_KEYS ? 1 : N_KEYS * 2; };
+  const auto& reducer = [](long long& sum, const long long& value) { sum += value; };
+  std::vector<long long> sums;
+#pragma omp parallel num_threads(4)
+  {
+    if (omp_get_thread_num() == 0) {
+      for (int i = 0; i < 10; i++) sums.push_back(m.map_reduce<long long>(mapper, reducer, 0));
+    } else {
+      for (int i = N_KEYS + omp_get_thread_num(); i < N_KEYS * 3; i += omp_get_num_threads() - 1) {
+        m.set(i, i);
+      }
+    }
+  }
+  for (const long long sum : sums) EXPECT_EQ(sum % (N_KEYS * 2), N_KEYS);
+  EXPECT_GE(m.get_n_keys(), N_KEYS * 2);
+  long long n_keys = 0;
+  m.apply([&](const int&, const int&) {
+#pragma omp atomic
+    n_keys++;
+  });
+  EXPECT_EQ(n_keys, m.get_n_keys());
+  EXPECT_GE(m.get_n_buckets(), m.get_n_keys());
+}
+
+TEST(OMPHashMapTest, Snapshot) {
+  omp_hash_map<int, int> m;
+  constexpr int N_KEYS = 100000;
+  for (int i = 0; i < N_KEYS; i++) m.set(i, i);
+  auto snapshot = m.snapshot();
+  EXPECT_EQ(snapshot->get_n_keys(), N_KEYS);
+
+  // The view keeps the values at its instant through updates, removals and inserts.
+  for (int i = 0; i < N_KEYS; i += 2) m.set(i, -i);
+  for (int i = 1; i < N_KEYS; i += 4) m.unset(i);
+  m.set(N_KEYS, N_KEYS);
+  EXPECT_FALSE(snapshot->has(N_KEYS));
+  EXPECT_TRUE(snapshot->has(1));
+  EXPECT_FALSE(m.has(1));
+  for (int i = 0; i < N_KEYS; i += 997) EXPECT_EQ(snapshot->get_copy_or_default(i, -1), i);
+  EXPECT_EQ(m.get_copy_or_default(2, 0), -2);
+  const auto& mapper = [](const int&, const int& value) { return static_cast<long long>(value); };
+  const auto& reducer = [](long long& sum, const long long& value) { sum += value; };
+  const long long sum = static_cast<long long>(N_KEYS) * (N_KEYS - 1) / 2;
+  EXPECT_EQ(snapshot->map_reduce<long long>(mapper, reducer, 0), sum);
+
+  // A rehash or a clear detaches the view, which then outlives the map.
+  auto cleared_snapshot = m.snapshot();
+  m.reserve(N_KEYS * 4);
+  EXPECT_EQ(snapshot->map_reduce<long long>(mapper, reducer, 0), sum);
+  m.clear();
+  EXPECT_EQ(cleared_snapshot->get_n_keys(), N_KEYS - N_KEYS / 4 + 1);
+  EXPECT_TRUE(cleared_snapshot->has(N_KEYS));
+  std::unique_ptr<omp_hash_map<int, int>::snapshot_view> orphaned_snapshot;
+  {
+    omp_hash_map<int, int> m2;
+    m2.set(1, 2);
+    orphaned_snapshot = m2.snapshot();
+  }
+  EXPECT_EQ(orphaned_snapshot->get_copy_or_default(1, 0), 2);
+}
+
+TEST(OMPHashMapTest, SnapshotOutlivesMap) {
+  // The orphaned views read only their own copies, which `make asan_test` checks.
+  std::unique_ptr<omp_hash_map<int, int>::snapshot_view> snapshot;
+  {
+    omp_hash_map<int, int> m(3);
+    for (int i = 0; i < 10000; i++) m.set(i, i * 2);
+    snapshot = m.snapshot();
+    m.set(0, 1);
+  }
+  omp_hash_map<int, int> other_m(1);
+  for (int i = 0; i < 10000; i++) other_m.set(i, 0);
+  EXPECT_EQ(snapshot->get_n_keys(), 10000);
+  for (int i = 0; i < 10000; i++) EXPECT_EQ(snapshot->get_copy_or_default(i, -1), i * 2);
+  long long sum = 0;
+  snapshot->apply([&](const int, const int value) {
+#pragma omp atomic
+    sum += value;
+  });
+  EXPECT_EQ(sum, 99990000);
+}
+
+TEST(OMPHashMapTest, SnapshotDuringUpdates) {
+  // The map reduce over a snapshot sees the values at its instant while the updates go on.
+  omp_hash_map<int, int> m;
+  constexpr int N_KEYS = 100000;
+  for (int i = 0; i < N_KEYS; i++) m.set(i, 1);
+  const auto& mapper = [](const int&, const int& value) { return static_cast<long long>(value); };
+  const auto& reducer = [](long long& sum, const long long& value) { sum += value; };
+  std::vector<long long> sums;
+#pragma omp parallel num_threads(4)
+  {
+    if (omp_get_thread_num() == 0) {
+      for (int i = 0; i < 10; i++) {
+        auto snapshot = m.snapshot();
+        const long long n_keys = snapshot->get_n_keys();
+        sums.push_back(snapshot->map_reduce<long long>(mapper, reducer, 0) - n_keys);
+      }
+    } else {
+      for (int i = omp_get_thread_num() - 1; i < N_KEYS * 3; i += omp_get_num_threads() - 1) {
+        if (i < N_KEYS) {
+          m.set(i, [](int& value) { value++; });
+        } else {
+          m.set(i, 1);
+        }
+      }
+    }
+  }
+  // Each key is incremented at most once, and the inserted keys are counted in the snapshots.
+  for (const long long sum : sums) {
+    EXPECT_GE(sum, 0);
+    EXPECT_LE(sum, N_KEYS);
+  }
+  auto snapshot = m.snapshot();
+  EXPECT_EQ(snapshot->get_n_keys(), N_KEYS * 3);
+  EXPECT_EQ(snapshot->map_reduce<long long>(mapper, reducer, 0), N_KEYS * 4);
+}
+
+TEST(OMPHashMapTest, BuildFrom) {
+  // Repeated keys take their last values, and the built map takes updates as usual.
+  std::vector<int> keys;
+  std::vector<int> values;
+  for (int i = 0; i < 100000; i++) {
+    keys.push_back(i % 60000);
+    values.push_back(i);
+  }
+  auto m = omp_hash_map<int, int>::build_from(keys, values);
+  EXPECT_EQ(m->get_n_keys(), 60000);
+  EXPECT_GE(m->get_n_buckets(), 60000);
+  for (int i = 0; i < 60000; i++) {
+    EXPECT_EQ(m->get_copy_or_default(i, -1), i < 40000 ? i + 60000 : i);
+  }
+  for (int i = 60000; i < 200000; i++) m->set(i, i);
+  m->unset(0);
+  EXPECT_EQ(m->get_n_keys(), 199999);
+  EXPECT_GE(m->get_n_buckets(), 199999);
+
+  using int_map = omp_hash_map<int, int>;
+  EXPECT_EQ(int_map::build_from({}, {})->get_n_keys(), 0);
+  EXPECT_THROW(int_map::build_from({1}, {}), std::invalid_argument);
+
+  // Keys colliding in one bucket reseed the hasher, as if inserted one by one.
+  struct weak_hasher {
+    uint64_t seed;
+    weak_hasher() : seed(0) {}
+    explicit weak_hasher(const uint64_t seed) : seed(seed) {}
+    size_t operator()(const int key) const { return seed ? omp_hashing::fmix64(key ^ seed) : 0; }
+  };
+  keys.resize(1000);
+  values.resize(1000);
+  auto flooded_map = omp_hash_map<int, int, weak_hasher>::build_from(keys, values);
+  EXPECT_NE(flooded_map->get_hash_seed(), 0);
+  EXPECT_EQ(flooded_map->get_n_keys(), 1000);
+  EXPECT_EQ(flooded_map->get_copy_or_default(999, -1), 999);
+}
+
+TEST(OMPHashMapTest, LockPolicies) {
+  const auto& check = [](auto& m) {
+#pragma omp parallel for
+    for (int i = 0; i < 10000; i++) m.set(i, i);
+    EXPECT_EQ(m.get_n_keys(), 10000);
+    for (int i = 0; i < 10000; i++) EXPECT_EQ(m.get_copy_or_default(i, -1), i);
+  };
+  omp_hash_map<int, int, omp_hash<int>, spin_lock> m1;
+  check(m1);
+  omp_hash_map<int, int, omp_hash<int>, ticket_lock> m2;
+  check(m2);
+  omp_hash_map<int, int, omp_hash<int>, futex_lock> m3;
+  check(m3);
+}
+
+TEST(OMPHashMapTest, Batch) {
+  omp_hash_map<int, int> m;
+  std::vector<int> keys, values;
+  for (int i = 0; i < 1000; i++) {
+    keys.push_back(i * 3);
+    values.push_back(i);
+  }
+  m.set_batch(keys, values);
+  EXPECT_EQ(m.get_n_keys(), 1000);
+  EXPECT_GE(m.get_n_buckets(), 1000);
+  for (int i = 0; i < 1000; i++) EXPECT_EQ(m.get_copy_or_default(i * 3, -1), i);
+
+  // Duplicated keys are set in order, so the last value wins.
+  m.set_batch({0, 0, 1}, {5, 6, 7});
+  EXPECT_EQ(m.get_n_keys(), 1001);
+  const std::vector<int>& got = m.get_batch({0, 1, 2, 3}, -1);
+  EXPECT_EQ(got, std::vector<int>({6, 7, -1, 1}));
+  EXPECT_THROW(m.set_batch({0, 1}, {0}), std::invalid_argument);
+
+  // Hashers without hash_batch hash each key.
+  omp_hash_map<std::string, int> m2;
+  m2.set_batch({"a", "b"}, {1, 2});
+  EXPECT_EQ(m2.get_batch({"b", "c", "a"}, 0), std::vector<int>({2, 0, 1}));
+}
+
+TEST(OMPHashMapLargeTest, TenMillionsGetBatch) {
+  omp_hash_map<int, int> m;
+  constexpr int LARGE_N_KEYS = 10000000;
+  constexpr int BATCH_SIZE = 1000;
+
+  m.reserve(LARGE_N_KEYS);
+#pragma omp parallel for
+  for (int i = 0; i < LARGE_N_KEYS; i += BATCH_SIZE) {
+    std::vector<int> keys(BATCH_SIZE);
+    for (int j = 0; j < BATCH_SIZE; j++) keys[j] = i + j;
+    m.set_batch(keys, keys);
+  }
+  long long sum = 0;
+#pragma omp parallel for reduction(+ : sum)
+  for (int i = 0; i < LARGE_N_KEYS; i += BATCH_SIZE) {
+    std::vector<int> keys(BATCH_SIZE);
+    for (int j = 0; j < BATCH_SIZE; j++) keys[j] = ((i + j) * 7919LL) % LARGE_N_KEYS;
+    for (const int value : m.get_batch(keys, 0)) sum += value;
+  }
+  EXPECT_EQ(sum, (LARGE_N_KEYS - 1LL) * LARGE_N_KEYS / 2);
+}
+
 TEST(OMPHashMapTest, Unset) {
   omp_hash_map<std::string, int> m;
   m.set("aa", 1);
@@ -96,6 +579,47 @@ TEST(OMPHashMapTest, Unset) {
   EXPECT_EQ(m.get_n_keys(), 0);
 }
 
+TEST(OMPHashMapTest, Collisions) {
+  // All the keys land in one bucket, so most of them overflow the inline node.
+  struct constant_hasher {
+    size_t operator()(const int) const { return 0; }
+  };
+  omp_hash_map<int, int, constant_hasher> m;
+  for (int i = 0; i < 100; i++) m.set(i, i);
+  EXPECT_EQ(m.get_n_keys(), 100);
+  for (int i = 0; i < 100; i += 3) m.unset(i);
+  for (int i = 0; i < 100; i++) {
+    EXPECT_EQ(m.has(i), i % 3 != 0);
+    EXPECT_EQ(m.get_copy_or_default(i, -1), i % 3 != 0 ? i : -1);
+  }
+  for (int i = 0; i < 100; i++) m.unset(i);
+  EXPECT_EQ(m.get_n_keys(), 0);
+  m.set(5, 25);
+  EXPECT_EQ(m.get_copy_or_default(5, 0), 25);
+}
+
+TEST(OMPHashMapTest, Reseed) {
+  // All the keys collide until the hasher is seeded, as if crafted against the default seed.
+  struct weak_hasher {
+    uint64_t seed;
+    weak_hasher() : seed(0) {}
+    explicit weak_hasher(const uint64_t seed) : seed(seed) {}
+    size_t operator()(const int key) const { return seed ? omp_hashing::fmix64(key ^ seed) : 0; }
+  };
+  omp_hash_map<int, int, weak_hasher> m;
+  EXPECT_EQ(m.get_hash_seed(), 0);
+  for (int i = 0; i < 1000; i++) m.set(i, i);
+  EXPECT_NE(m.get_hash_seed(), 0);
+  EXPECT_EQ(m.get_n_keys(), 1000);
+  for (int i = 0; i < 1000; i++) EXPECT_EQ(m.get_copy_or_default(i, -1), i);
+
+  omp_hash_map<std::string, int> m2;
+  for (int i = 0; i < 100; i++) m2.set(std::to_string(i), i);
+  m2.set_hash_seed(12345);
+  EXPECT_EQ(m2.get_hash_seed(), 12345);
+  for (int i = 0; i < 100; i++) EXPECT_EQ(m2.get_copy_or_default(std::to_string(i), -1), i);
+}
+
 TEST(OMPHashMapTest, Map) {
   omp_hash_map<std::string, int> m;
   const auto& cubic = [&](const int value) { return value * value * value; };
@@ -165,4 +689,12 @@ TEST(OMPHashMapTest, Clear) {
   EXPECT_FALSE(m.has("aa"));
   EXPECT_FALSE(m.has("bbb"));
   EXPECT_EQ(m.get_n_keys(), 0);
+
+  // Clear after rehashing.
+  for (int i = 0; i < 1000; i++) m.set(std::to_string(i), i);
+  m.clear();
+  EXPECT_EQ(m.get_n_keys(), 0);
+  EXPECT_FALSE(m.has("999"));
+  m.set("999", 1);
+  EXPECT_TRUE(m.has("999"));
 }
\ No newline at end of file
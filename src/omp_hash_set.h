@@ -1,21 +1,48 @@
 #ifndef omp_hash_set_H_
 #define omp_hash_set_H_
 
+#include <algorithm>
 #include <array>
+#include <cstdlib>
 #include <functional>
 #include <memory>
+#include <new>
+#include <random>
+#include <stdexcept>
+#include <type_traits>
 #include <vector>
+#include "bloom_filter.h"
+#include "first_touch.h"
+#include "lock.h"
 #include "omp.h"
+#include "omp_hash.h"
 
 // A high performance concurrent hash map based on OpenMP.
-template <class K, class H = std::hash<K>>
+// K must be default constructible, since empty buckets hold their first node inline.
+// If H is constructible from a uint64_t seed, as omp_hash is, a chain grown beyond the expected
+// length, such as from keys crafted to collide, reseeds the hasher with a random seed and rehashes.
+// L is the lock policy of the segments, one of those in lock.h.
+// An optional Bloom filter answers most tests of absent keys without any lock.
+template <class K, class H = omp_hash<K>, class L = omp_lock>
 class omp_hash_set {
  public:
-  omp_hash_set();
+  // The bucket array can be backed by huge pages to reduce TLB misses on large tables.
+  // The set is divided into N_SEGMENTS_PER_THREAD segments per thread, each with its own lock.
+  explicit omp_hash_set(const page_policy policy = page_policy::normal);
+
+  // Same as above with the specified number of segments.
+  explicit omp_hash_set(const size_t n_segments, const page_policy policy = page_policy::normal);
 
   ~omp_hash_set();
 
+  // Return a new set of the keys, built in parallel without locks: the keys are counted per
+  // bucket, the buckets are allocated for all of them at once, and the keys are scattered into
+  // them. Repeated keys are added once.
+  static std::unique_ptr<omp_hash_set> build_from(
+      const std::vector<K>& keys, const page_policy policy = page_policy::normal);
+
   // Set the number of buckets in the container to be at least the specified value.
+  // Throw std::bad_alloc, leaving the set as it was, if the buckets cannot be allocated.
   void reserve(const size_t n_buckets) {
     const size_t n_rehashing_buckets = get_n_rehashing_buckets(n_buckets);
     rehash(n_rehashing_buckets);
@@ -25,7 +52,7 @@ class omp_hash_set {
   size_t get_n_buckets() const { return n_buckets; };
 
   // Return the current load factor (the ratio between the number of keys and buckets).
-  double get_load_factor() const { return static_cast<double>(n_keys) / n_buckets; }
+  double get_load_factor() const { return static_cast<double>(get_n_keys()) / n_buckets; }
 
   // Return the max load factor beyond which an automatic rehashing will occur.
   double get_max_load_factor() const { return max_load_factor; }
@@ -33,20 +60,51 @@ class omp_hash_set {
   // Set the max load factor beyond which an automatic rehashing will occur.
   void set_max_load_factor(const double max_load_factor) {
     this->max_load_factor = max_load_factor;
+    is_near_max_load = true;
   }
 
-  // Return the number of keys.
-  size_t get_n_keys() const { return n_keys; }
+  // Return the number of keys, summed over the segments.
+  // Exact unless keys are being inserted or removed concurrently, or a rehash is ending, when the
+  // counts of some segments may be from before the rehash and the others from after.
+  size_t get_n_keys() const;
+
+  // Return the number of segments, which is the number of locks.
+  size_t get_n_segments() const { return segments->size(); }
+
+  // Grow the number of segments on rehashing, to N_SEGMENTS_PER_THREAD per current thread, or to
+  // one per N_BUCKETS_PER_SEGMENT buckets if more. Disabled by default, and never shrinks.
+  void set_segment_growth(const bool enabled) { is_segment_growth_enabled = enabled; }
+
+  // Let apply() and map_reduce() over all the keys lock one segment at a time, for a chunk of its
+  // buckets, instead of holding back all the updates until they finish. Disabled by default.
+  // The traversals are then weakly consistent:
+  // - Each key present during the whole traversal is visited exactly once.
+  // - A key added or removed during the traversal may or may not be visited.
+  // - The visited keys may never have been present together.
+  // - Rehashing for the max load factor is put off until the end of the traversal, and the other
+  //   operations on the whole container wait for it.
+  // The handlers shall not call the container.
+  void set_weakly_consistent_traversal(const bool enabled) {
+    is_weakly_consistent_traversal_enabled = enabled;
+  }
 
   // Set the specified key.
   void add(const K& key);
 
+  // Set the specified keys.
+  // The keys are hashed together, with H::hash_batch if H provides it.
+  void add_batch(const std::vector<K>& keys);
+
   // Remove the specified key.
   void remove(const K& key);
 
   // Test if the specified key exists.
   bool has(const K& key);
 
+  // Test if each of the specified keys exists.
+  // The keys are hashed together, with H::hash_batch if H provides it.
+  std::vector<bool> has_batch(const std::vector<K>& keys);
+
   // Return the reduced value of the mapped values of all the keys.
   // If no key exists, return the default value.
   template <class W>
@@ -61,135 +119,683 @@ class omp_hash_set {
   // Clear all keys.
   void clear();
 
- private:
-  size_t n_keys;
+  // Reseed the hasher and rehash all the keys. H must be constructible from a uint64_t seed.
+  void set_hash_seed(const uint64_t seed);
+
+  // Return the seed of the hasher. Zero unless reseeded.
+  uint64_t get_hash_seed() const { return __atomic_load_n(&hash_seed, __ATOMIC_RELAXED); }
 
+  // Enable or disable a Bloom filter of the keys, with which has() answers most absent keys without
+  // locking a segment or touching the buckets. The filter takes 2 bytes per key of the capacity of
+  // the buckets and is rebuilt on rehashing and after many removals. It never shrinks.
+  void set_bloom_filter(const bool enabled);
+
+  bool is_bloom_filter_enabled() const { return bloom_filter != nullptr; }
+
+ private:
   size_t n_buckets;
 
   double max_load_factor;
 
-  size_t n_threads;
+  // Only read within global operations. The others hash with make_seeded_hasher(hash_seed).
+  H hasher;
 
-  // The entire hash map is divided into several segments (depends on how many threads).
-  // Each segment can be locked and accessed independently in parallel.
-  size_t n_segments;
+  // Changed only within global operations, and read atomically without them.
+  uint64_t hash_seed;
 
-  H hasher;
+  // The number of automatic reseeds since construction or clearing.
+  size_t n_reseeds;
+
+  page_policy policy;
+
+  // The filters are tested without locks, so the replaced ones are kept until destruction.
+  // A filter is only replaced by a larger one, so the replaced ones take less memory in total.
+  std::vector<std::unique_ptr<blocked_bloom_filter>> bloom_filters;
+
+  // The current filter, or nullptr if disabled.
+  blocked_bloom_filter* bloom_filter;
+
+  // Odd while a global operation is running, and incremented at its start and end.
+  // An operation in a segment checks the version after locking the segment, and backs off if it has
+  // changed since the operation read the buckets. So a global operation only announces itself and
+  // waits for the operations in the segments at the time, instead of holding the segment locks.
+  // A test of the filter without locks also detects a concurrent rebuild, rehash or reseed by it,
+  // and falls back to the locked lookup.
+  size_t global_version;
+
+  L global_lock;
 
-  std::vector<omp_lock_t> segment_locks;
+  bool is_weakly_consistent_traversal_enabled;
 
-  // For parallel rehashing (Require omp_set_nested(1)).
-  std::vector<omp_lock_t> rehashing_segment_locks;
+  // Set while a weakly consistent traversal holds the global lock, so that an insert reaching the
+  // max load factor leaves the rehash to a later insert instead of waiting for the traversal.
+  bool is_traversing_weakly;
+
+  // The number of buckets of a segment visited per task in a traversal.
+  constexpr static size_t N_TRAVERSAL_CHUNK_BUCKETS = 256;
+
+  // The number of keys removed since the last rebuild, whose bits are still set in the filter.
+  size_t n_bloom_filter_removals;
 
   constexpr static size_t N_INITIAL_BUCKETS = 11;
 
   constexpr static size_t N_SEGMENTS_PER_THREAD = 7;
 
+  constexpr static size_t N_BUCKETS_PER_SEGMENT = 4096;
+
   constexpr static double DEFAULT_MAX_LOAD_FACTOR = 1.0;
 
-  struct hash_node {
+  // The number of keys the batch operations prefetch ahead.
+  constexpr static size_t PREFETCH_DISTANCE = 8;
+
+  constexpr static size_t CACHE_LINE_SIZE = 64;
+
+  constexpr static bool IS_SEEDABLE = std::is_constructible<H, uint64_t>::value;
+
+  // Keys which still collide after this many reseeds are left in long chains.
+  constexpr static size_t MAX_N_RESEEDS = 4;
+
+  // The locks and the key counter of a segment fill a cache line of their own, so that threads
+  // working on adjacent segments never invalidate the lines of each other.
+  struct alignas(CACHE_LINE_SIZE) hash_segment {
+    L lock;
+    // For parallel rehashing, by the threads of the rehash and the threads helping it.
+    L rehashing_lock;
+    // The number of keys, updated under the lock and read by get_n_keys() without it.
+    size_t n_keys;
+    // The number of keys moved into the segment by a rehash, updated under the rehashing lock.
+    // It replaces n_keys at the end of the rehash, so that n_keys stays valid until then.
+    size_t n_rehashed_keys;
+    // Set while an operation which has seen the current global version holds the lock, so that a
+    // global operation waits for the operation to finish without taking the lock.
+    bool is_in_use;
+    hash_segment() : n_keys(0), n_rehashed_keys(0), is_in_use(false) {}
+  };
+
+  typedef first_touch_array<hash_segment> segment_array;
+
+  // The entire hash set is divided into several segments, each of which can be locked and accessed
+  // independently in parallel. Growing the segments publishes a new array, so that a thread always
+  // computes the segment id within the array it locks, and detects the change after locking.
+  segment_array* segments;
+
+  // All the segment arrays. The replaced ones are kept until destruction, since other threads may
+  // still be waiting on their locks.
+  std::vector<std::unique_ptr<segment_array>> segment_arrays;
+
+  bool is_segment_growth_enabled;
+
+  // Set once a segment holds its share of the max number of keys, after which every insert checks
+  // the number of keys summed over the segments. Only cleared within a global operation.
+  bool is_near_max_load;
+
+  // Set while a thread rehashes for the max load factor, so that the other threads reaching it at
+  // the same time do not lock all the segments in turn only to find the buckets already grown.
+  bool is_rehashing_for_load;
+
+  struct hash_entry {
     K key;
+  };
+
+  // The number of entries per node, so that a node of small keys fills a cache line.
+  constexpr static size_t N_NODE_ENTRIES =
+      sizeof(hash_entry) * 2 + sizeof(void*) < CACHE_LINE_SIZE
+          ? (CACHE_LINE_SIZE - sizeof(void*) - 1) / sizeof(hash_entry)
+          : 1;
+
+  // A node holds a small array of entries, so that a chain walk is mostly a scan of one cache line.
+  // All the nodes of a bucket except the last one are full.
+  struct alignas(CACHE_LINE_SIZE) hash_node {
+    std::array<hash_entry, N_NODE_ENTRIES> entries;
+    unsigned char n_entries;
     std::unique_ptr<hash_node> next;
-    hash_node(const K& key) : key(key){};
+    hash_node() : n_entries(0){};
+
+    // Keep the overflow nodes cache line aligned without C++17 aligned new.
+    static void* operator new(const size_t size) {
+      void* p = nullptr;
+      if (posix_memalign(&p, CACHE_LINE_SIZE, size) != 0) throw std::bad_alloc();
+      return p;
+    }
+    static void operator delete(void* p) { free(p); }
   };
 
-  std::vector<std::unique_ptr<hash_node>> buckets;
+  // The first node of each bucket is stored inline in the bucket array, so that looking up a
+  // bucket with a few keys takes no pointer chasing. Only the overflow nodes are chained.
+  typedef hash_node hash_bucket;
+
+  // The max number of nodes in a chain before an automatic reseed. Around 32 keys, which is far
+  // beyond the chain lengths of random hash values at the max load factor.
+  constexpr static size_t MAX_CHAIN_LENGTH = 32 / N_NODE_ENTRIES + 1;
+
+  // The bucket pages are spread across NUMA nodes by first touch. All the parallel loops over the
+  // buckets use a static schedule so that each thread mostly touches the pages local to it.
+  first_touch_array<hash_bucket> buckets;
+
+  // A rehash in progress, which the threads finding a segment locked help with instead of blocking,
+  // so that a rehash started within a parallel region is parallel even without nesting.
+  // The buckets are claimed in chunks, so that threads can join at any time.
+  struct rehash_job {
+    first_touch_array<hash_bucket>* rehashing_buckets;
+    size_t n_rehashing_buckets;
+    segment_array* rehashing_segments;
+    size_t n_claimed_buckets;
+    size_t n_rehashed_buckets;
+    // Set while the fields above are valid. The rehashing thread waits for the helpers to leave
+    // before it reuses them.
+    bool is_active;
+    size_t n_helpers;
+    rehash_job() : is_active(false), n_helpers(0) {}
+  };
+
+  rehash_job rehash_in_progress;
+
+  constexpr static size_t N_REHASH_CHUNK_BUCKETS = 1024;
 
   // Set the number of buckets to be at least the number of current keys times max load factor.
-  void rehash() { reserve(n_keys / max_load_factor); }
+  void rehash() { reserve(get_n_keys() / max_load_factor); }
+
+  // Rehash if an insert makes the number of keys reach the max load factor.
+  // Until a segment holds its share of the max number of keys, an insert only checks the counter
+  // of its own segment, so most inserts read and write no counter shared with other threads.
+  void rehash_if_overloaded(const size_t n_segment_keys) {
+    if (n_segment_keys == 0) return;
+    const double max_n_keys = n_buckets * max_load_factor;
+    if (!is_near_max_load) {
+      if (n_segment_keys * segments->size() < max_n_keys) return;
+      is_near_max_load = true;
+    }
+    if (get_n_keys() >= max_n_keys) rehash_for_load();
+  }
+
+  // Rehash for the max load factor, unless another thread is already doing so, in which case help
+  // its rehash and return, since the key inserted by this thread is already counted.
+  void rehash_for_load();
+
+  // Set is_near_max_load if any segment holds its share of the max number of keys.
+  // Must be called within a global operation.
+  void update_near_max_load();
+
+  // Add the delta to the key counter of the segment of the bucket and return the new count.
+  // Must be called with the segment locked.
+  size_t add_n_segment_keys(const hash_bucket& bucket, const int delta) {
+    size_t& n_keys = (*segments)[(&bucket - &buckets[0]) % segments->size()].n_keys;
+    const size_t n_updated_keys = n_keys + delta;
+    __atomic_store_n(&n_keys, n_updated_keys, __ATOMIC_RELAXED);
+    return n_updated_keys;
+  }
 
   void rehash(const size_t n_rehashing_buckets);
 
+  // Move all the nodes into a new bucket array of the specified size, and grow the segments if
+  // enabled. Must be called within a global operation.
+  void rehash_locked(const size_t n_rehashing_buckets);
+
+  // Return the number of segments to grow to for the specified number of buckets.
+  size_t get_n_grown_segments(const size_t n_rehashing_buckets) const;
+
+  // Rehash the unclaimed chunks of the buckets. Return true if any bucket was rehashed.
+  bool run_rehash_job();
+
+  // Join the rehash in progress, if any. Return true if any bucket was rehashed.
+  bool help_rehash();
+
+  // Lock the segment lock, helping the rehash in progress while it is held by the rehash.
+  void lock_segment(L& lock) {
+    while (!lock.try_lock()) {
+      if (!help_rehash()) {
+        lock.lock();
+        return;
+      }
+    }
+  }
+
+  // Lock the segment for an operation which has read the buckets at the specified version of the
+  // global operations. Return false, with the segment unlocked, if a global operation has started
+  // since.
+  bool lock_segment(hash_segment& segment, const size_t version);
+
+  void unlock_segment(hash_segment& segment);
+
+  // Wait until the operation in the segment, if any, finishes. Within a global operation, no other
+  // operation starts in the segment afterwards.
+  static void wait_for_segment(const hash_segment& segment);
+
+  // Reseed the hasher with a random seed and rehash, unless another thread has already reseeded
+  // since the hasher of the specified seed found a long chain.
+  void reseed(const uint64_t flooded_hash_seed);
+
+  // Resize the filter if needed and add all the keys into it again.
+  // Must be called within a global operation.
+  void rebuild_bloom_filter_locked();
+
+  // Add the key of the hash value computed under the seed into the filter, if enabled. The key is
+  // only hashed again if reseeded since. Must be called with the segment of the key locked.
+  void add_to_bloom_filter(const K& key, const size_t hash_value, const uint64_t hash_value_seed) {
+    if (!bloom_filter) return;
+    if (hash_value_seed == hash_seed) {
+      bloom_filter->add(hash_value);
+    } else {
+      bloom_filter->add(make_seeded_hasher(hash_seed)(key));
+    }
+  }
+
+  // Return true if the filter shows the key of the hash value computed under the seed is absent.
+  bool is_filtered_out(const size_t hash_value, const uint64_t hash_value_seed) const;
+
   // Get the number of hash buckets to use.
   // This number shall be larger than or equal to the specified number.
   size_t get_n_rehashing_buckets(const size_t n_buckets) const;
 
-  // Apply node_handler to the hash node which has the specific key.
-  // If the key does not exist, apply to the unassociated node from the corresponding bucket.
+  // Apply node_handler to the bucket of the specific key and the hash entry which has the key.
+  // If the key does not exist, apply to the bucket and nullptr.
   void hash_node_apply(
-      const K& key, const std::function<void(std::unique_ptr<hash_node>&)>& node_handler);
-
-  // Apply node_handler to all the hash nodes.
-  void hash_node_apply(const std::function<void(std::unique_ptr<hash_node>&)>& node_handler);
+      const K& key, const std::function<void(hash_bucket&, hash_entry*)>& node_handler);
 
-  // Recursively find the node with the specified key on the list starting from the node specified.
-  // Then apply the specified handler to that node.
-  // If the key does not exist, apply the handler to the unassociated node at the end of the list.
-  void hash_node_apply_recursive(
-      std::unique_ptr<hash_node>& node,
+  // Same as above with the hash value of the key precomputed under the specified seed.
+  // The key is hashed again if the hasher has been reseeded since.
+  void hash_node_apply(
       const K& key,
-      const std::function<void(std::unique_ptr<hash_node>&)>& node_handler);
+      size_t hash_value,
+      uint64_t hash_value_seed,
+      const std::function<void(hash_bucket&, hash_entry*)>& node_handler);
 
-  // Recursively apply the handler to each node on the list from the node specified (post-order).
-  void hash_node_apply_recursive(
-      std::unique_ptr<hash_node>& node,
-      const std::function<void(std::unique_ptr<hash_node>&)>& node_handler);
+  // Return the hasher of the specified seed, the same as the hasher member once reseeded with it.
+  // The operations in the segments hash with it instead of reading the member, which a reseed may
+  // assign meanwhile.
+  static H make_seeded_hasher(const uint64_t seed) {
+    return seed == 0 ? H() : omp_hashing::make_hasher<H>(seed);
+  }
+
+  // Return the hash values of the keys and the seed they are computed under.
+  std::vector<size_t> hash_keys(const std::vector<K>& keys, uint64_t& hash_value_seed) const;
+
+  // Size the buckets for the keys and return the indices of the keys ordered by bucket, with the
+  // end of the indices of each bucket in bucket_ends. Only for a set not yet shared.
+  std::vector<size_t> sort_by_bucket(const std::vector<K>& keys, std::vector<size_t>& bucket_ends);
+
+  // The number of keys hashed together in a parallel build.
+  constexpr static size_t N_BUILD_CHUNK_KEYS = 1024;
+
+  // Prefetch the bucket of the hash value, so that the batch operations overlap the cache misses
+  // of the next keys with the current one. A stale number of buckets only wastes the prefetch.
+  void prefetch_bucket(const size_t hash_value) {
+    __builtin_prefetch(&buckets[hash_value % n_buckets]);
+  }
 
-  void lock_all_segments();
+  // Apply node_handler to all the hash entries.
+  void hash_node_apply(const std::function<void(hash_entry&)>& node_handler);
 
-  void unlock_all_segments();
+  // Same as above, locking one segment at a time.
+  void hash_node_apply_weakly(const std::function<void(hash_entry&)>& node_handler);
+
+  // Apply node_handler to all the hash entries, in chunks of the buckets of one segment. Each
+  // segment is locked around its chunks if is_locking, and otherwise waited for once within a
+  // global operation.
+  void hash_node_apply_by_segment(
+      const std::function<void(hash_entry&)>& node_handler, const bool is_locking);
+
+  // Apply node_handler to each entry of the specified bucket.
+  static void bucket_apply(
+      hash_bucket& bucket, const std::function<void(hash_entry&)>& node_handler);
+
+  // Return the entry which has the specified key in the bucket, or nullptr if not found.
+  static hash_entry* find_entry(hash_bucket& bucket, const K& key);
+
+  // Append a new entry to the last node of the bucket, or to a new overflow node if it is full.
+  // Return the new entry.
+  static hash_entry* insert_entry(hash_bucket& bucket, K key);
+
+  // Remove the specified entry from the bucket by moving the last entry of the bucket into it.
+  static void remove_entry(hash_bucket& bucket, hash_entry* entry);
+
+  // Return the number of nodes of the bucket, counting up to MAX_CHAIN_LENGTH + 1.
+  static size_t get_chain_length(const hash_bucket& bucket);
+
+  // Move all the nodes of the bucket into the rehashing buckets, counted in the rehashing segments.
+  void rehash_bucket(
+      hash_bucket& bucket,
+      first_touch_array<hash_bucket>& rehashing_buckets,
+      const size_t n_rehashing_buckets,
+      segment_array& rehashing_segments);
+
+  // Start an operation on the whole container, such as a rehash, a clear or a traversal, which
+  // waits for the operations in the segments to finish and holds back new ones until it ends.
+  // Global operations are serialized.
+  void begin_global_operation();
+
+  // Same as above without waiting for the operations in the segments. The buckets of a segment
+  // shall only be accessed after wait_for_segment() on it.
+  void announce_global_operation();
+
+  void end_global_operation();
+
+  // Wait until no global operation is running, helping the rehash in progress if any.
+  // Return the version of the global operations, which is even.
+  size_t wait_for_global_operation();
 };
 
-template <class K, class H>
-omp_hash_set<K, H>::omp_hash_set() {
-  n_keys = 0;
+template <class K, class H, class L>
+omp_hash_set<K, H, L>::omp_hash_set(const page_policy policy)
+    : omp_hash_set(omp_get_max_threads() * N_SEGMENTS_PER_THREAD, policy) {}
+
+template <class K, class H, class L>
+omp_hash_set<K, H, L>::omp_hash_set(const size_t n_segments, const page_policy policy)
+    : policy(policy) {
+  if (n_segments == 0) throw std::invalid_argument("n_segments must be positive");
+  is_near_max_load = false;
+  hash_seed = 0;
+  n_reseeds = 0;
+  bloom_filter = nullptr;
+  global_version = 0;
+  n_bloom_filter_removals = 0;
   n_buckets = N_INITIAL_BUCKETS;
-  buckets.resize(n_buckets);
+  buckets = first_touch_array<hash_bucket>(n_buckets, policy);
   max_load_factor = DEFAULT_MAX_LOAD_FACTOR;
 
-  n_threads = omp_get_max_threads();
-  n_segments = n_threads * N_SEGMENTS_PER_THREAD;
-  segment_locks.resize(n_segments);
-  rehashing_segment_locks.resize(n_segments);
-  for (auto& lock : segment_locks) omp_init_lock(&lock);
-  for (auto& lock : rehashing_segment_locks) omp_init_lock(&lock);
+  segment_arrays.emplace_back(new segment_array(n_segments));
+  segments = segment_arrays.back().get();
+  is_segment_growth_enabled = false;
+  is_rehashing_for_load = false;
+  is_weakly_consistent_traversal_enabled = false;
+  is_traversing_weakly = false;
 }
 
-template <class K, class H>
-omp_hash_set<K, H>::~omp_hash_set() {
+template <class K, class H, class L>
+omp_hash_set<K, H, L>::~omp_hash_set() {
   clear();
-  for (auto& lock : segment_locks) omp_destroy_lock(&lock);
-  for (auto& lock : rehashing_segment_locks) omp_destroy_lock(&lock);
 }
 
-template <class K, class H>
-void omp_hash_set<K, H>::rehash(const size_t n_rehashing_buckets) {
-  lock_all_segments();
+template <class K, class H, class L>
+std::unique_ptr<omp_hash_set<K, H, L>> omp_hash_set<K, H, L>::build_from(
+    const std::vector<K>& keys, const page_policy policy) {
+  std::unique_ptr<omp_hash_set> m(new omp_hash_set(policy));
+  std::vector<size_t> bucket_ends;
+  const std::vector<size_t>& key_ids = m->sort_by_bucket(keys, bucket_ends);
+  segment_array& built_segments = *m->segments;
+  const size_t n_segments = built_segments.size();
+  bool has_long_chain = false;
+#pragma omp parallel
+  {
+    std::vector<size_t> n_segment_keys(n_segments, 0);
+#pragma omp for schedule(static)
+    for (size_t i = 0; i < m->n_buckets; i++) {
+      hash_bucket& bucket = m->buckets[i];
+      for (size_t j = i == 0 ? 0 : bucket_ends[i - 1]; j < bucket_ends[i]; j++) {
+        const K& key = keys[key_ids[j]];
+        if (find_entry(bucket, key)) continue;
+        insert_entry(bucket, key);
+        n_segment_keys[i % n_segments]++;
+      }
+      if (IS_SEEDABLE && get_chain_length(bucket) > MAX_CHAIN_LENGTH) {
+        __atomic_store_n(&has_long_chain, true, __ATOMIC_RELAXED);
+      }
+    }
+    for (size_t i = 0; i < n_segments; i++) {
+      __atomic_fetch_add(&built_segments[i].n_keys, n_segment_keys[i], __ATOMIC_RELAXED);
+    }
+  }
+  m->update_near_max_load();
+  if (has_long_chain) m->reseed(m->hash_seed);
+  return m;
+}
 
-  // No decrease in the number of buckets.
-  if (n_buckets >= n_rehashing_buckets) {
-    unlock_all_segments();
-    return;
+template <class K, class H, class L>
+std::vector<size_t> omp_hash_set<K, H, L>::sort_by_bucket(
+    const std::vector<K>& keys, std::vector<size_t>& bucket_ends) {
+  const size_t n_keys = keys.size();
+  n_buckets = get_n_rehashing_buckets(n_keys / max_load_factor);
+  buckets = first_touch_array<hash_bucket>(n_buckets, policy);
+
+  // Hash the keys into their bucket ids and count the keys of each bucket.
+  std::vector<size_t> bucket_ids(n_keys);
+  bucket_ends.assign(n_buckets, 0);
+#pragma omp parallel for schedule(static)
+  for (size_t begin = 0; begin < n_keys; begin += N_BUILD_CHUNK_KEYS) {
+    const size_t end = std::min(begin + N_BUILD_CHUNK_KEYS, n_keys);
+    omp_hashing::hash_batch(hasher, &keys[begin], end - begin, &bucket_ids[begin]);
+    for (size_t i = begin; i < end; i++) {
+      bucket_ids[i] %= n_buckets;
+      __atomic_fetch_add(&bucket_ends[bucket_ids[i]], 1, __ATOMIC_RELAXED);
+    }
   }
 
-  // Rehash.
-  std::vector<std::unique_ptr<hash_node>> rehashing_buckets(n_rehashing_buckets);
-  const auto& node_handler = [&](std::unique_ptr<hash_node>& node) {
-    const auto& rehashing_node_handler = [&](std::unique_ptr<hash_node>& rehashing_node) {
-      rehashing_node = std::move(node);
-      rehashing_node->next.reset();
-    };
-    const K& key = node->key;
-    const size_t hash_value = hasher(key);
-    const size_t bucket_id = hash_value % n_rehashing_buckets;
-    const size_t segment_id = bucket_id % n_segments;
-    auto& lock = rehashing_segment_locks[segment_id];
-    omp_set_lock(&lock);
-    hash_node_apply_recursive(rehashing_buckets[bucket_id], key, rehashing_node_handler);
-    omp_unset_lock(&lock);
-  };
-#pragma omp parallel for
-  for (size_t i = 0; i < n_buckets; i++) {
-    hash_node_apply_recursive(buckets[i], node_handler);
+  // Turn the counts into the beginnings of the buckets, each thread summing a range of them.
+  std::vector<size_t> range_begins(omp_get_max_threads() + 1, 0);
+#pragma omp parallel
+  {
+    const size_t n_threads = omp_get_num_threads();
+    const size_t thread_id = omp_get_thread_num();
+    const size_t begin = n_buckets * thread_id / n_threads;
+    const size_t end = n_buckets * (thread_id + 1) / n_threads;
+    size_t n_range_keys = 0;
+    for (size_t i = begin; i < end; i++) n_range_keys += bucket_ends[i];
+    range_begins[thread_id + 1] = n_range_keys;
+#pragma omp barrier
+#pragma omp single
+    for (size_t i = 0; i < n_threads; i++) range_begins[i + 1] += range_begins[i];
+    size_t bucket_begin = range_begins[thread_id];
+    for (size_t i = begin; i < end; i++) {
+      const size_t n_bucket_keys = bucket_ends[i];
+      bucket_ends[i] = bucket_begin;
+      bucket_begin += n_bucket_keys;
+    }
+  }
+
+  // Scatter the key ids, which moves the beginning of each bucket to its end.
+  std::vector<size_t> key_ids(n_keys);
+#pragma omp parallel for schedule(static)
+  for (size_t i = 0; i < n_keys; i++) {
+    key_ids[__atomic_fetch_add(&bucket_ends[bucket_ids[i]], 1, __ATOMIC_RELAXED)] = i;
   }
+  return key_ids;
+}
+
+template <class K, class H, class L>
+void omp_hash_set<K, H, L>::rehash(const size_t n_rehashing_buckets) {
+  begin_global_operation();
+  try {
+    // No decrease in the number of buckets.
+    if (n_buckets < n_rehashing_buckets) rehash_locked(n_rehashing_buckets);
+  } catch (...) {
+    end_global_operation();
+    throw;
+  }
+  end_global_operation();
+}
+
+template <class K, class H, class L>
+void omp_hash_set<K, H, L>::rehash_locked(const size_t n_rehashing_buckets) {
+  // The buckets and the segments are allocated first, so that the set is as it was if either
+  // allocation throws. The threads which have read the old segments back off on the change of the
+  // global version.
+  first_touch_array<hash_bucket> rehashing_buckets(n_rehashing_buckets, policy);
+  const size_t n_grown_segments = get_n_grown_segments(n_rehashing_buckets);
+  if (n_grown_segments > segments->size()) {
+    segment_arrays.emplace_back(new segment_array(n_grown_segments));
+  }
+  segment_array& rehashing_segments = *segment_arrays.back();
+
+  // The keys move across the segments, so they are counted again as they are moved.
+  for (size_t i = 0; i < rehashing_segments.size(); i++) {
+    rehashing_segments[i].n_rehashed_keys = 0;
+  }
+  rehash_job& job = rehash_in_progress;
+  job.rehashing_buckets = &rehashing_buckets;
+  job.n_rehashing_buckets = n_rehashing_buckets;
+  job.rehashing_segments = &rehashing_segments;
+  job.n_claimed_buckets = 0;
+  job.n_rehashed_buckets = 0;
+  __atomic_store_n(&job.is_active, true, __ATOMIC_SEQ_CST);
+#pragma omp parallel
+  run_rehash_job();
+  while (__atomic_load_n(&job.n_rehashed_buckets, __ATOMIC_ACQUIRE) < n_buckets) sched_yield();
+  __atomic_store_n(&job.is_active, false, __ATOMIC_SEQ_CST);
+  while (__atomic_load_n(&job.n_helpers, __ATOMIC_SEQ_CST) > 0) sched_yield();
 
   buckets = std::move(rehashing_buckets);
   n_buckets = n_rehashing_buckets;
-  unlock_all_segments();
+  for (size_t i = 0; i < rehashing_segments.size(); i++) {
+    hash_segment& segment = rehashing_segments[i];
+    __atomic_store_n(&segment.n_keys, segment.n_rehashed_keys, __ATOMIC_RELAXED);
+  }
+  __atomic_store_n(&segments, &rehashing_segments, __ATOMIC_RELEASE);
+  update_near_max_load();
+  rebuild_bloom_filter_locked();
+}
+
+template <class K, class H, class L>
+void omp_hash_set<K, H, L>::rehash_for_load() {
+  if (__atomic_exchange_n(&is_rehashing_for_load, true, __ATOMIC_ACQUIRE)) {
+    help_rehash();
+    return;
+  }
+  if (__atomic_load_n(&is_traversing_weakly, __ATOMIC_RELAXED)) {
+    __atomic_store_n(&is_rehashing_for_load, false, __ATOMIC_RELEASE);
+    return;
+  }
+  try {
+    // Another thread may have rehashed since this one read the number of buckets, and the numbers
+    // of buckets are coarse for large tables, so the keys may not yet need more buckets.
+    const size_t n_rehashing_buckets = get_n_rehashing_buckets(get_n_keys() / max_load_factor);
+    if (n_rehashing_buckets > n_buckets) rehash(n_rehashing_buckets);
+  } catch (...) {
+    __atomic_store_n(&is_rehashing_for_load, false, __ATOMIC_RELEASE);
+    throw;
+  }
+  __atomic_store_n(&is_rehashing_for_load, false, __ATOMIC_RELEASE);
+}
+
+template <class K, class H, class L>
+bool omp_hash_set<K, H, L>::run_rehash_job() {
+  rehash_job& job = rehash_in_progress;
+  bool has_rehashed = false;
+  while (true) {
+    const size_t begin =
+        __atomic_fetch_add(&job.n_claimed_buckets, N_REHASH_CHUNK_BUCKETS, __ATOMIC_RELAXED);
+    if (begin >= n_buckets) return has_rehashed;
+    const size_t end = std::min(begin + N_REHASH_CHUNK_BUCKETS, n_buckets);
+    for (size_t i = begin; i < end; i++) {
+      rehash_bucket(
+          buckets[i], *job.rehashing_buckets, job.n_rehashing_buckets, *job.rehashing_segments);
+    }
+    __atomic_fetch_add(&job.n_rehashed_buckets, end - begin, __ATOMIC_RELEASE);
+    has_rehashed = true;
+  }
+}
+
+template <class K, class H, class L>
+bool omp_hash_set<K, H, L>::help_rehash() {
+  // The helper registers before it checks the job again, so that either the rehashing thread waits
+  // for it, or it sees the job has ended.
+  rehash_job& job = rehash_in_progress;
+  if (!__atomic_load_n(&job.is_active, __ATOMIC_RELAXED)) return false;
+  __atomic_fetch_add(&job.n_helpers, 1, __ATOMIC_SEQ_CST);
+  const bool has_rehashed = __atomic_load_n(&job.is_active, __ATOMIC_SEQ_CST) && run_rehash_job();
+  __atomic_fetch_sub(&job.n_helpers, 1, __ATOMIC_RELEASE);
+  return has_rehashed;
+}
+
+template <class K, class H, class L>
+size_t omp_hash_set<K, H, L>::get_n_grown_segments(const size_t n_rehashing_buckets) const {
+  if (!is_segment_growth_enabled) return segments->size();
+  const size_t n_thread_segments = omp_get_max_threads() * N_SEGMENTS_PER_THREAD;
+  const size_t n_bucket_segments = n_rehashing_buckets / N_BUCKETS_PER_SEGMENT;
+  return std::max(n_thread_segments, n_bucket_segments);
+}
+
+template <class K, class H, class L>
+void omp_hash_set<K, H, L>::set_bloom_filter(const bool enabled) {
+  begin_global_operation();
+  if (enabled && !bloom_filter) {
+    if (bloom_filters.empty()) {
+      bloom_filters.emplace_back(new blocked_bloom_filter(n_buckets * max_load_factor, policy));
+    }
+    __atomic_store_n(&bloom_filter, bloom_filters.back().get(), __ATOMIC_RELEASE);
+    rebuild_bloom_filter_locked();
+  } else if (!enabled) {
+    __atomic_store_n(&bloom_filter, nullptr, __ATOMIC_RELEASE);
+  }
+  end_global_operation();
+}
+
+template <class K, class H, class L>
+void omp_hash_set<K, H, L>::rebuild_bloom_filter_locked() {
+  if (!bloom_filter) return;
+  const size_t n_filter_keys = n_buckets * max_load_factor;
+  if (bloom_filter->get_capacity() < n_filter_keys) {
+    bloom_filters.emplace_back(new blocked_bloom_filter(n_filter_keys, policy));
+    __atomic_store_n(&bloom_filter, bloom_filters.back().get(), __ATOMIC_RELEASE);
+  } else {
+    bloom_filter->clear();
+  }
+  const auto& node_handler = [&](hash_entry& entry) { bloom_filter->add(hasher(entry.key)); };
+#pragma omp parallel for schedule(static)
+  for (size_t i = 0; i < n_buckets; i++) {
+    bucket_apply(buckets[i], node_handler);
+  }
+  n_bloom_filter_removals = 0;
+}
+
+template <class K, class H, class L>
+bool omp_hash_set<K, H, L>::is_filtered_out(
+    const size_t hash_value, const uint64_t hash_value_seed) const {
+  // A seqlock read: the result only counts if no whole set operation overlapped the test.
+  const size_t version = __atomic_load_n(&global_version, __ATOMIC_ACQUIRE);
+  const blocked_bloom_filter* filter = __atomic_load_n(&bloom_filter, __ATOMIC_ACQUIRE);
+  if (!filter || (version & 1)) return false;
+  if (hash_value_seed != __atomic_load_n(&hash_seed, __ATOMIC_RELAXED)) return false;
+  const bool may_contain = filter->may_contain(hash_value);
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return !may_contain && __atomic_load_n(&global_version, __ATOMIC_RELAXED) == version;
+}
+
+template <class K, class H, class L>
+void omp_hash_set<K, H, L>::set_hash_seed(const uint64_t seed) {
+  static_assert(IS_SEEDABLE, "H must be constructible from a uint64_t seed");
+  begin_global_operation();
+  hasher = make_seeded_hasher(seed);
+  __atomic_store_n(&hash_seed, seed, __ATOMIC_RELAXED);
+  rehash_locked(n_buckets);
+  end_global_operation();
+}
+
+template <class K, class H, class L>
+void omp_hash_set<K, H, L>::reseed(const uint64_t flooded_hash_seed) {
+  begin_global_operation();
+  if (hash_seed == flooded_hash_seed && n_reseeds < MAX_N_RESEEDS) {
+    std::random_device random_device;
+    const uint64_t seed = (static_cast<uint64_t>(random_device()) << 32) | random_device();
+    hasher = make_seeded_hasher(seed);
+    __atomic_store_n(&hash_seed, seed, __ATOMIC_RELAXED);
+    n_reseeds++;
+    rehash_locked(n_buckets);
+  }
+  end_global_operation();
 }
 
-template <class K, class H>
-size_t omp_hash_set<K, H>::get_n_rehashing_buckets(const size_t n_buckets_in) const {
+template <class K, class H, class L>
+void omp_hash_set<K, H, L>::update_near_max_load() {
+  const segment_array& locked_segments = *segments;
+  const double max_n_segment_keys = n_buckets * max_load_factor / locked_segments.size();
+  is_near_max_load = false;
+  for (size_t i = 0; i < locked_segments.size(); i++) {
+    if (locked_segments[i].n_keys >= max_n_segment_keys) is_near_max_load = true;
+  }
+}
+
+template <class K, class H, class L>
+size_t omp_hash_set<K, H, L>::get_n_keys() const {
+  const segment_array& current_segments = *__atomic_load_n(&segments, __ATOMIC_ACQUIRE);
+  size_t n_keys = 0;
+  for (size_t i = 0; i < current_segments.size(); i++) {
+    n_keys += __atomic_load_n(&current_segments[i].n_keys, __ATOMIC_RELAXED);
+  }
+  return n_keys;
+}
+
+template <class K, class H, class L>
+size_t omp_hash_set<K, H, L>::get_n_rehashing_buckets(const size_t n_buckets_in) const {
   // Returns a number that is greater than or equal to n_buckets_in.
   // That number is either a prime number itself, or a product of two prime numbers.
   // Returns a number that is greater than or equal to n_buckets_in.
@@ -222,52 +828,114 @@ size_t omp_hash_set<K, H>::get_n_rehashing_buckets(const size_t n_buckets_in) co
   return n_rehashing_buckets;
 }
 
-template <class K, class H>
-void omp_hash_set<K, H>::add(const K& key) {
-  const auto& node_handler = [&](std::unique_ptr<hash_node>& node) {
-    if (!node) {
-      node.reset(new hash_node(key));
-#pragma omp atomic
-      n_keys++;
+template <class K, class H, class L>
+void omp_hash_set<K, H, L>::add(const K& key) {
+  const uint64_t hash_value_seed = __atomic_load_n(&hash_seed, __ATOMIC_RELAXED);
+  const size_t hash_value = make_seeded_hasher(hash_value_seed)(key);
+  size_t n_segment_keys = 0;
+  const auto& node_handler = [&](hash_bucket& bucket, hash_entry* entry) {
+    if (!entry) {
+      insert_entry(bucket, key);
+      add_to_bloom_filter(key, hash_value, hash_value_seed);
+      n_segment_keys = add_n_segment_keys(bucket, 1);
     }
   };
-  hash_node_apply(key, node_handler);
-  if (n_keys >= n_buckets * max_load_factor) rehash();
+  hash_node_apply(key, hash_value, hash_value_seed, node_handler);
+  rehash_if_overloaded(n_segment_keys);
 }
 
-template <class K, class H>
-void omp_hash_set<K, H>::remove(const K& key) {
-  const auto& node_handler = [&](std::unique_ptr<hash_node>& node) {
-    if (node) {
-      node = std::move(node->next);
+template <class K, class H, class L>
+void omp_hash_set<K, H, L>::add_batch(const std::vector<K>& keys) {
+  uint64_t hash_value_seed;
+  const std::vector<size_t>& hash_values = hash_keys(keys, hash_value_seed);
+  const size_t n = keys.size();
+  size_t i;
+  size_t n_segment_keys = 0;
+  const std::function<void(hash_bucket&, hash_entry*)> node_handler = [&](
+      hash_bucket& bucket, hash_entry* entry) {
+    if (!entry) {
+      insert_entry(bucket, keys[i]);
+      add_to_bloom_filter(keys[i], hash_values[i], hash_value_seed);
+      n_segment_keys = add_n_segment_keys(bucket, 1);
+    }
+  };
+  for (i = 0; i < n; i++) {
+    n_segment_keys = 0;
+    if (i + PREFETCH_DISTANCE < n) prefetch_bucket(hash_values[i + PREFETCH_DISTANCE]);
+    hash_node_apply(keys[i], hash_values[i], hash_value_seed, node_handler);
+    rehash_if_overloaded(n_segment_keys);
+  }
+}
+
+template <class K, class H, class L>
+void omp_hash_set<K, H, L>::remove(const K& key) {
+  const auto& node_handler = [&](hash_bucket& bucket, hash_entry* entry) {
+    if (entry) {
+      remove_entry(bucket, entry);
+      add_n_segment_keys(bucket, -1);
+      if (bloom_filter) {
 #pragma omp atomic
-      n_keys--;
+        n_bloom_filter_removals++;
+      }
     }
   };
   hash_node_apply(key, node_handler);
+
+  // Rebuild once the stale bits are about half of the capacity, so that the false positive rate
+  // stays bounded and the rebuilds take amortized constant time per removal.
+  const blocked_bloom_filter* filter = __atomic_load_n(&bloom_filter, __ATOMIC_ACQUIRE);
+  if (filter && n_bloom_filter_removals > filter->get_capacity() / 2) {
+    begin_global_operation();
+    if (bloom_filter && n_bloom_filter_removals > bloom_filter->get_capacity() / 2) {
+      rebuild_bloom_filter_locked();
+    }
+    end_global_operation();
+  }
 }
 
-template <class K, class H>
-bool omp_hash_set<K, H>::has(const K& key) {
+template <class K, class H, class L>
+bool omp_hash_set<K, H, L>::has(const K& key) {
+  const uint64_t hash_value_seed = __atomic_load_n(&hash_seed, __ATOMIC_RELAXED);
+  const size_t hash_value = make_seeded_hasher(hash_value_seed)(key);
+  if (is_filtered_out(hash_value, hash_value_seed)) return false;
   bool has_key = false;
-  const auto& node_handler = [&](const std::unique_ptr<hash_node>& node) {
-    if (node) has_key = true;
+  const auto& node_handler = [&](hash_bucket&, hash_entry* entry) {
+    if (entry) has_key = true;
   };
-  hash_node_apply(key, node_handler);
+  hash_node_apply(key, hash_value, hash_value_seed, node_handler);
   return has_key;
 }
 
-template <class K, class H>
+template <class K, class H, class L>
+std::vector<bool> omp_hash_set<K, H, L>::has_batch(const std::vector<K>& keys) {
+  uint64_t hash_value_seed;
+  const std::vector<size_t>& hash_values = hash_keys(keys, hash_value_seed);
+  const size_t n = keys.size();
+  std::vector<bool> has_keys(n, false);
+  size_t i;
+  const std::function<void(hash_bucket&, hash_entry*)> node_handler = [&](
+      hash_bucket&, hash_entry* entry) {
+    if (entry) has_keys[i] = true;
+  };
+  for (i = 0; i < n; i++) {
+    if (i + PREFETCH_DISTANCE < n) prefetch_bucket(hash_values[i + PREFETCH_DISTANCE]);
+    if (is_filtered_out(hash_values[i], hash_value_seed)) continue;
+    hash_node_apply(keys[i], hash_values[i], hash_value_seed, node_handler);
+  }
+  return has_keys;
+}
+
+template <class K, class H, class L>
 template <class W>
-W omp_hash_set<K, H>::map_reduce(
+W omp_hash_set<K, H, L>::map_reduce(
     const std::function<W(const K&)>& mapper,
     const std::function<void(W&, const W&)>& reducer,
     const W& default_value) {
-  std::vector<W> thread_reduced_values(n_threads, default_value);
+  std::vector<W> thread_reduced_values(omp_get_max_threads(), default_value);
   W reduced_value = default_value;
-  const auto& node_handler = [&](std::unique_ptr<hash_node>& node) {
+  const auto& node_handler = [&](hash_entry& entry) {
     const size_t thread_id = omp_get_thread_num();
-    const W& mapped_value = mapper(node->key);
+    const W& mapped_value = mapper(entry.key);
     reducer(thread_reduced_values[thread_id], mapped_value);
   };
   hash_node_apply(node_handler);
@@ -275,95 +943,267 @@ W omp_hash_set<K, H>::map_reduce(
   return reduced_value;
 }
 
-template <class K, class H>
-void omp_hash_set<K, H>::apply(const std::function<void(const K&)>& handler) {
-  const auto& node_handler = [&](std::unique_ptr<hash_node>& node) { handler(node->key); };
+template <class K, class H, class L>
+void omp_hash_set<K, H, L>::apply(const std::function<void(const K&)>& handler) {
+  const auto& node_handler = [&](hash_entry& entry) { handler(entry.key); };
   hash_node_apply(node_handler);
 }
 
-template <class K, class H>
-void omp_hash_set<K, H>::clear() {
-  lock_all_segments();
+template <class K, class H, class L>
+void omp_hash_set<K, H, L>::clear() {
+  first_touch_array<hash_bucket> initial_buckets(N_INITIAL_BUCKETS, policy);
+  begin_global_operation();
 
-#pragma omp parallel for
-  for (size_t i = 0; i < n_buckets; i++) {
-    buckets[i].reset();
+  // The old buckets and their nodes are released in parallel.
+  buckets = std::move(initial_buckets);
+  n_buckets = N_INITIAL_BUCKETS;
+  for (size_t i = 0; i < segments->size(); i++) {
+    __atomic_store_n(&(*segments)[i].n_keys, 0, __ATOMIC_RELAXED);
   }
+  is_near_max_load = false;
+  n_reseeds = 0;
+  rebuild_bloom_filter_locked();
+  end_global_operation();
+}
 
-  buckets.resize(N_INITIAL_BUCKETS);
-  for (auto& bucket : buckets) bucket.reset();
-  n_keys = 0;
-  unlock_all_segments();
+template <class K, class H, class L>
+void omp_hash_set<K, H, L>::hash_node_apply(
+    const K& key, const std::function<void(hash_bucket&, hash_entry*)>& node_handler) {
+  // The hash value is computed under the seed read here, and a reseed since is detected under the
+  // lock.
+  const uint64_t hash_value_seed = __atomic_load_n(&hash_seed, __ATOMIC_RELAXED);
+  hash_node_apply(key, make_seeded_hasher(hash_value_seed)(key), hash_value_seed, node_handler);
 }
 
-template <class K, class H>
-void omp_hash_set<K, H>::hash_node_apply(
-    const K& key, const std::function<void(std::unique_ptr<hash_node>&)>& node_handler) {
-  const size_t hash_value = hasher(key);
+template <class K, class H, class L>
+void omp_hash_set<K, H, L>::hash_node_apply(
+    const K& key,
+    size_t hash_value,
+    uint64_t hash_value_seed,
+    const std::function<void(hash_bucket&, hash_entry*)>& node_handler) {
   bool applied = false;
+  bool is_long_chain = false;
+  uint64_t hash_seed_snapshot;
   while (!applied) {
+    // The buckets, the segments and the seed only change within a global operation.
+    const size_t version = wait_for_global_operation();
     const size_t n_buckets_snapshot = n_buckets;
+    segment_array* const segments_snapshot = segments;
+    hash_seed_snapshot = __atomic_load_n(&hash_seed, __ATOMIC_RELAXED);
+    if (hash_seed_snapshot != hash_value_seed) {
+      hash_value = make_seeded_hasher(hash_seed_snapshot)(key);
+      hash_value_seed = hash_seed_snapshot;
+    }
     const size_t bucket_id = hash_value % n_buckets_snapshot;
-    const size_t segment_id = bucket_id % n_segments;
-    auto& lock = segment_locks[segment_id];
-    omp_set_lock(&lock);
-    if (n_buckets_snapshot != n_buckets) {
-      omp_unset_lock(&lock);
-      continue;
+    const size_t segment_id = bucket_id % segments_snapshot->size();
+    hash_segment& segment = (*segments_snapshot)[segment_id];
+    if (!lock_segment(segment, version)) continue;
+    hash_bucket& bucket = buckets[bucket_id];
+    node_handler(bucket, find_entry(bucket, key));
+    if (IS_SEEDABLE && n_reseeds < MAX_N_RESEEDS) {
+      is_long_chain = get_chain_length(bucket) > MAX_CHAIN_LENGTH;
     }
-    hash_node_apply_recursive(buckets[bucket_id], key, node_handler);
-    omp_unset_lock(&lock);
+    unlock_segment(segment);
     applied = true;
   }
+  if (is_long_chain) reseed(hash_seed_snapshot);
 }
 
-template <class K, class H>
-void omp_hash_set<K, H>::hash_node_apply(
-    const std::function<void(std::unique_ptr<hash_node>&)>& node_handler) {
-  lock_all_segments();
-// For a good hash function, a static schedule shall provide both a good balance and speed.
-#pragma omp parallel for
-  for (size_t i = 0; i < n_buckets; i++) {
-    hash_node_apply_recursive(buckets[i], node_handler);
+template <class K, class H, class L>
+std::vector<size_t> omp_hash_set<K, H, L>::hash_keys(
+    const std::vector<K>& keys, uint64_t& hash_value_seed) const {
+  hash_value_seed = __atomic_load_n(&hash_seed, __ATOMIC_RELAXED);
+  std::vector<size_t> hash_values(keys.size());
+  omp_hashing::hash_batch(
+      make_seeded_hasher(hash_value_seed), keys.data(), keys.size(), hash_values.data());
+  return hash_values;
+}
+
+template <class K, class H, class L>
+void omp_hash_set<K, H, L>::hash_node_apply(
+    const std::function<void(hash_entry&)>& node_handler) {
+  if (is_weakly_consistent_traversal_enabled) {
+    hash_node_apply_weakly(node_handler);
+    return;
   }
-  unlock_all_segments();
+  // Each segment is visited as soon as the operation in it at the start has finished.
+  announce_global_operation();
+  hash_node_apply_by_segment(node_handler, false);
+  end_global_operation();
 }
 
-template <class K, class H>
-void omp_hash_set<K, H>::hash_node_apply_recursive(
-    std::unique_ptr<hash_node>& node,
-    const K& key,
-    const std::function<void(std::unique_ptr<hash_node>&)>& node_handler) {
-  if (node) {
-    if (node->key == key) {
-      node_handler(node);
+template <class K, class H, class L>
+void omp_hash_set<K, H, L>::hash_node_apply_weakly(
+    const std::function<void(hash_entry&)>& node_handler) {
+  // The global lock keeps the buckets and the segments in place without announcing a global
+  // operation, so the updates go on in the segments not being visited.
+  lock_segment(global_lock);
+  __atomic_store_n(&is_traversing_weakly, true, __ATOMIC_RELAXED);
+  hash_node_apply_by_segment(node_handler, true);
+  __atomic_store_n(&is_traversing_weakly, false, __ATOMIC_RELAXED);
+  global_lock.unlock();
+
+  // Run the rehash put off by the inserts during the traversal.
+  if (get_n_keys() >= n_buckets * max_load_factor) rehash_for_load();
+}
+
+template <class K, class H, class L>
+void omp_hash_set<K, H, L>::hash_node_apply_by_segment(
+    const std::function<void(hash_entry&)>& node_handler, const bool is_locking) {
+  segment_array& visiting_segments = *segments;
+  const size_t n_segments = visiting_segments.size();
+  const size_t n_segment_buckets = (n_buckets + n_segments - 1) / n_segments;
+  const size_t n_chunks = (n_segment_buckets + N_TRAVERSAL_CHUNK_BUCKETS - 1) /
+                          N_TRAVERSAL_CHUNK_BUCKETS;
+  // Adjacent tasks visit different segments, so that the threads rarely wait for each other, and
+  // a static schedule still hands each thread a contiguous range of the buckets.
+#pragma omp parallel for schedule(static)
+  for (size_t task = 0; task < n_chunks * n_segments; task++) {
+    const size_t segment_id = task % n_segments;
+    const size_t begin = segment_id + task / n_segments * N_TRAVERSAL_CHUNK_BUCKETS * n_segments;
+    const size_t end = std::min(begin + N_TRAVERSAL_CHUNK_BUCKETS * n_segments, n_buckets);
+    hash_segment& segment = visiting_segments[segment_id];
+    if (is_locking) {
+      lock_segment(segment.lock);
     } else {
-      hash_node_apply_recursive(node->next, key, node_handler);
+      wait_for_segment(segment);
     }
-  } else {
-    node_handler(node);
+    for (size_t i = begin; i < end; i += n_segments) bucket_apply(buckets[i], node_handler);
+    if (is_locking) segment.lock.unlock();
   }
 }
 
-template <class K, class H>
-void omp_hash_set<K, H>::hash_node_apply_recursive(
-    std::unique_ptr<hash_node>& node,
-    const std::function<void(std::unique_ptr<hash_node>&)>& node_handler) {
-  if (node) {
-    // Post-order traversal for rehashing.
-    hash_node_apply_recursive(node->next, node_handler);
-    node_handler(node);
+template <class K, class H, class L>
+void omp_hash_set<K, H, L>::bucket_apply(
+    hash_bucket& bucket, const std::function<void(hash_entry&)>& node_handler) {
+  for (hash_node* node = &bucket; node; node = node->next.get()) {
+    for (size_t i = 0; i < node->n_entries; i++) node_handler(node->entries[i]);
   }
 }
 
-template <class K, class H>
-void omp_hash_set<K, H>::lock_all_segments() {
-  for (auto& lock : segment_locks) omp_set_lock(&lock);
+template <class K, class H, class L>
+typename omp_hash_set<K, H, L>::hash_entry* omp_hash_set<K, H, L>::find_entry(
+    hash_bucket& bucket, const K& key) {
+  for (hash_node* node = &bucket; node; node = node->next.get()) {
+    for (size_t i = 0; i < node->n_entries; i++) {
+      if (node->entries[i].key == key) return &node->entries[i];
+    }
+  }
+  return nullptr;
 }
 
-template <class K, class H>
-void omp_hash_set<K, H>::unlock_all_segments() {
-  for (auto& lock : segment_locks) omp_unset_lock(&lock);
+template <class K, class H, class L>
+typename omp_hash_set<K, H, L>::hash_entry* omp_hash_set<K, H, L>::insert_entry(
+    hash_bucket& bucket, K key) {
+  hash_node* node = &bucket;
+  while (node->next) node = node->next.get();
+  if (node->n_entries == N_NODE_ENTRIES) {
+    node->next.reset(new hash_node());
+    node = node->next.get();
+  }
+  hash_entry& entry = node->entries[node->n_entries];
+  entry.key = std::move(key);
+  node->n_entries++;
+  return &entry;
+}
+
+template <class K, class H, class L>
+void omp_hash_set<K, H, L>::remove_entry(hash_bucket& bucket, hash_entry* entry) {
+  hash_node* last_node = &bucket;
+  std::unique_ptr<hash_node>* last_link = nullptr;
+  while (last_node->next) {
+    last_link = &last_node->next;
+    last_node = last_node->next.get();
+  }
+  hash_entry& last_entry = last_node->entries[last_node->n_entries - 1];
+  if (entry != &last_entry) *entry = std::move(last_entry);
+  last_entry = hash_entry();
+  last_node->n_entries--;
+  if (last_node->n_entries == 0 && last_link) last_link->reset();
+}
+
+template <class K, class H, class L>
+void omp_hash_set<K, H, L>::rehash_bucket(
+    hash_bucket& bucket,
+    first_touch_array<hash_bucket>& rehashing_buckets,
+    const size_t n_rehashing_buckets,
+    segment_array& rehashing_segments) {
+  const auto& node_handler = [&](hash_entry& entry) {
+    const size_t bucket_id = hasher(entry.key) % n_rehashing_buckets;
+    hash_segment& segment = rehashing_segments[bucket_id % rehashing_segments.size()];
+    auto& lock = segment.rehashing_lock;
+    lock.lock();
+    insert_entry(rehashing_buckets[bucket_id], std::move(entry.key));
+    segment.n_rehashed_keys++;
+    lock.unlock();
+  };
+  bucket_apply(bucket, node_handler);
+  bucket.next.reset();
+  bucket.n_entries = 0;
+}
+
+template <class K, class H, class L>
+size_t omp_hash_set<K, H, L>::get_chain_length(const hash_bucket& bucket) {
+  size_t chain_length = 1;
+  for (const hash_node* node = bucket.next.get(); node && chain_length <= MAX_CHAIN_LENGTH;
+       node = node->next.get()) {
+    chain_length++;
+  }
+  return chain_length;
+}
+
+template <class K, class H, class L>
+bool omp_hash_set<K, H, L>::lock_segment(hash_segment& segment, const size_t version) {
+  lock_segment(segment.lock);
+  // The flag is set before the version is read, and a global operation increments the version
+  // before reading the flag, so either the operation sees the new version or the global operation
+  // sees the flag.
+  __atomic_store_n(&segment.is_in_use, true, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&global_version, __ATOMIC_SEQ_CST) == version) return true;
+  __atomic_store_n(&segment.is_in_use, false, __ATOMIC_RELAXED);
+  segment.lock.unlock();
+  return false;
+}
+
+template <class K, class H, class L>
+void omp_hash_set<K, H, L>::unlock_segment(hash_segment& segment) {
+  __atomic_store_n(&segment.is_in_use, false, __ATOMIC_RELEASE);
+  segment.lock.unlock();
+}
+
+template <class K, class H, class L>
+void omp_hash_set<K, H, L>::wait_for_segment(const hash_segment& segment) {
+  while (__atomic_load_n(&segment.is_in_use, __ATOMIC_ACQUIRE)) sched_yield();
+}
+
+template <class K, class H, class L>
+void omp_hash_set<K, H, L>::begin_global_operation() {
+  // The operations in flight all finish in parallel, so the wait lasts as long as the longest of
+  // them, and no segment lock is taken.
+  announce_global_operation();
+  segment_array& draining_segments = *segments;
+  for (size_t i = 0; i < draining_segments.size(); i++) wait_for_segment(draining_segments[i]);
+}
+
+template <class K, class H, class L>
+void omp_hash_set<K, H, L>::announce_global_operation() {
+  lock_segment(global_lock);
+  __atomic_store_n(&global_version, global_version + 1, __ATOMIC_SEQ_CST);
+}
+
+template <class K, class H, class L>
+void omp_hash_set<K, H, L>::end_global_operation() {
+  __atomic_store_n(&global_version, global_version + 1, __ATOMIC_RELEASE);
+  global_lock.unlock();
+}
+
+template <class K, class H, class L>
+size_t omp_hash_set<K, H, L>::wait_for_global_operation() {
+  while (true) {
+    const size_t version = __atomic_load_n(&global_version, __ATOMIC_ACQUIRE);
+    if (!(version & 1)) return version;
+    if (!help_rehash()) sched_yield();
+  }
 }
 
 #endif
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "omp_hash_set.h"
+#include <algorithm>
 #include "gtest/gtest.h"
 #include "omp.h"
 #include "reducer.h"
@@ -34,6 +35,24 @@ TEST(OMPHashSetTest, OneMillionReserve) {
   EXPECT_GE(n_buckets, LARGE_N_BUCKETS);
 }
 
+// AddressSanitizer aborts on allocations beyond its max size instead of failing them.
+#ifndef __SANITIZE_ADDRESS__
+TEST(OMPHashSetTest, FailedReserve) {
+  // The buckets of the reserve exceed the address space, so the allocation fails, and the set is
+  // left as it was and still takes updates.
+  omp_hash_set<int> m;
+  for (int i = 0; i < 100; i++) m.add(i);
+  const size_t n_buckets = m.get_n_buckets();
+  EXPECT_THROW(m.reserve(1000000000000000ULL), std::bad_alloc);
+  EXPECT_EQ(m.get_n_buckets(), n_buckets);
+  EXPECT_EQ(m.get_n_keys(), 100);
+  for (int i = 0; i < 200; i++) m.add(i);
+  for (int i = 0; i < 200; i++) EXPECT_TRUE(m.has(i));
+  m.clear();
+  EXPECT_EQ(m.get_n_keys(), 0);
+}
+#endif
+
 TEST(OMPHashSetLargeTest, HundredMillionsReserve) {
   omp_hash_set<std::string> m;
   constexpr size_t LARGE_N_BUCKETS = 100000000;
@@ -69,6 +88,75 @@ TEST(OMPHashSetLargeTest, TenMillionsInsertWithAutoRehash) {
   EXPECT_GE(m.get_n_buckets(), LARGE_N_KEYS);
 }
 
+TEST(OMPHashSetTest, Segments) {
+  omp_hash_set<int> s(1);
+  EXPECT_EQ(s.get_n_segments(), 1);
+  s.set_segment_growth(true);
+  s.set_bloom_filter(true);
+#pragma omp parallel for
+  for (int i = 0; i < 1000000; i++) s.add(i);
+  EXPECT_GE(s.get_n_segments(), s.get_n_buckets() / 4096);
+  EXPECT_EQ(s.get_n_keys(), 1000000);
+  for (int i = 0; i < 1000000; i++) ASSERT_TRUE(s.has(i));
+  EXPECT_FALSE(s.has(-1));
+}
+
+TEST(OMPHashSetTest, WeaklyConsistentTraversal) {
+  omp_hash_set<int> s;
+  s.set_weakly_consistent_traversal(true);
+  for (int i = 0; i < 100000; i++) s.add(i);
+  long long sum = 0;
+  s.apply([&](const int& key) {
+#pragma omp atomic
+    sum += key;
+  });
+  EXPECT_EQ(sum, 99999LL * 100000 / 2);
+  const auto& mapper = [](const int&) { return 1; };
+  const auto& reducer = [](int& total, const int& value) { total += value; };
+  EXPECT_EQ(s.map_reduce<int>(mapper, reducer, 0), 100000);
+}
+
+TEST(OMPHashSetTest, BuildFrom) {
+  std::vector<int> keys;
+  for (int i = 0; i < 100000; i++) keys.push_back(i % 60000);
+  auto m = omp_hash_set<int>::build_from(keys);
+  EXPECT_EQ(m->get_n_keys(), 60000);
+  for (int i = 0; i < 60000; i++) EXPECT_TRUE(m->has(i));
+  EXPECT_FALSE(m->has(60000));
+  for (int i = 60000; i < 200000; i++) m->add(i);
+  EXPECT_EQ(m->get_n_keys(), 200000);
+  EXPECT_GE(m->get_n_buckets(), 200000);
+  EXPECT_EQ(omp_hash_set<int>::build_from({})->get_n_keys(), 0);
+}
+
+TEST(OMPHashSetTest, LockPolicies) {
+  const auto& check = [](auto& s) {
+#pragma omp parallel for
+    for (int i = 0; i < 10000; i++) s.add(i % 5000);
+    EXPECT_EQ(s.get_n_keys(), 5000);
+    for (int i = 0; i < 5000; i++) EXPECT_TRUE(s.has(i));
+  };
+  omp_hash_set<int, omp_hash<int>, spin_lock> s1;
+  check(s1);
+  omp_hash_set<int, omp_hash<int>, ticket_lock> s2;
+  check(s2);
+  omp_hash_set<int, omp_hash<int>, futex_lock> s3;
+  check(s3);
+}
+
+TEST(OMPHashSetTest, Batch) {
+  omp_hash_set<long long> m;
+  std::vector<long long> keys;
+  for (long long i = 0; i < 1000; i++) keys.push_back(i << 32);
+  m.add_batch(keys);
+  m.add_batch({0, 1});
+  EXPECT_EQ(m.get_n_keys(), 1001);
+  EXPECT_GE(m.get_n_buckets(), 1001);
+  const std::vector<bool>& has_keys = m.has_batch(keys);
+  EXPECT_EQ(std::count(has_keys.begin(), has_keys.end(), true), 1000);
+  EXPECT_EQ(m.has_batch({1, 2, 1LL << 32}), std::vector<bool>({true, false, true}));
+}
+
 TEST(OMPHashSetTest, Remove) {
   omp_hash_set<std::string> m;
   m.add("aa");
@@ -87,6 +175,129 @@ TEST(OMPHashSetTest, Remove) {
   EXPECT_EQ(m.get_n_keys(), 0);
 }
 
+TEST(OMPHashSetTest, BloomFilter) {
+  omp_hash_set<int> m;
+  for (int i = 0; i < 1000; i += 2) m.add(i);
+  EXPECT_FALSE(m.is_bloom_filter_enabled());
+  m.set_bloom_filter(true);
+  EXPECT_TRUE(m.is_bloom_filter_enabled());
+  for (int i = 0; i < 1000; i++) EXPECT_EQ(m.has(i), i % 2 == 0);
+
+  // Adding keys rehashes into a larger filter.
+  for (int i = 1000; i < 100000; i++) m.add(i);
+  for (int i = 0; i < 100000; i++) EXPECT_EQ(m.has(i), i >= 1000 || i % 2 == 0);
+  const std::vector<bool>& has_keys = m.has_batch({0, 1, 99999, 100000});
+  EXPECT_EQ(has_keys, std::vector<bool>({true, false, true, false}));
+
+  // Removing most keys rebuilds the filter.
+  for (int i = 0; i < 90000; i++) m.remove(i);
+  EXPECT_EQ(m.get_n_keys(), 10000);
+  for (int i = 0; i < 100000; i++) EXPECT_EQ(m.has(i), i >= 90000);
+
+  m.set_hash_seed(12345);
+  for (int i = 89990; i < 90010; i++) EXPECT_EQ(m.has(i), i >= 90000);
+  m.add(1);
+  m.add_batch({2, 3});
+  for (int i = 0; i < 5; i++) EXPECT_EQ(m.has(i), i >= 1 && i <= 3);
+
+  m.clear();
+  EXPECT_TRUE(m.is_bloom_filter_enabled());
+  EXPECT_FALSE(m.has(99999));
+  m.add(99999);
+  EXPECT_TRUE(m.has(99999));
+
+  m.set_bloom_filter(false);
+  EXPECT_FALSE(m.is_bloom_filter_enabled());
+  m.add(5);
+  m.set_bloom_filter(true);
+  EXPECT_TRUE(m.has(5));
+  EXPECT_TRUE(m.has(99999));
+}
+
+TEST(OMPHashSetTest, ConcurrentBloomFilter) {
+  // Tests without locks run during the rehashing and rebuilds of the filter.
+  omp_hash_set<int> m;
+  m.set_bloom_filter(true);
+  constexpr int N_KEYS = 100000;
+  int n_wrong = 0;
+#pragma omp parallel for reduction(+ : n_wrong)
+  for (int i = 0; i < N_KEYS; i++) {
+    m.add(i);
+    if (!m.has(i)) n_wrong++;
+    if (m.has(i + N_KEYS)) n_wrong++;
+    if (i % 2) m.remove(i);
+  }
+  EXPECT_EQ(n_wrong, 0);
+  EXPECT_EQ(m.get_n_keys(), N_KEYS / 2);
+#pragma omp parallel for reduction(+ : n_wrong)
+  for (int i = 0; i < N_KEYS; i++) {
+    if (m.has(i) != (i % 2 == 0)) n_wrong++;
+  }
+  EXPECT_EQ(n_wrong, 0);
+}
+
+TEST(OMPHashSetLargeTest, TenMillionsMisses) {
+  omp_hash_set<int> m;
+  constexpr int LARGE_N_KEYS = 10000000;
+
+  m.reserve(LARGE_N_KEYS);
+#pragma omp parallel for
+  for (int i = 0; i < LARGE_N_KEYS; i++) m.add(i);
+  int n_found = 0;
+#pragma omp parallel for reduction(+ : n_found)
+  for (int i = 0; i < LARGE_N_KEYS; i++) n_found += m.has(i + LARGE_N_KEYS) ? 1 : 0;
+  EXPECT_EQ(n_found, 0);
+}
+
+TEST(OMPHashSetLargeTest, TenMillionsMissesWithBloomFilter) {
+  omp_hash_set<int> m;
+  constexpr int LARGE_N_KEYS = 10000000;
+
+  m.reserve(LARGE_N_KEYS);
+  m.set_bloom_filter(true);
+#pragma omp parallel for
+  for (int i = 0; i < LARGE_N_KEYS; i++) m.add(i);
+  int n_found = 0;
+#pragma omp parallel for reduction(+ : n_found)
+  for (int i = 0; i < LARGE_N_KEYS; i++) n_found += m.has(i + LARGE_N_KEYS) ? 1 : 0;
+  EXPECT_EQ(n_found, 0);
+}
+
+TEST(OMPHashSetTest, Collisions) {
+  // All the keys land in one bucket, so most of them overflow the inline node.
+  struct constant_hasher {
+    size_t operator()(const int) const { return 0; }
+  };
+  omp_hash_set<int, constant_hasher> m;
+  for (int i = 0; i < 100; i++) m.add(i);
+  EXPECT_EQ(m.get_n_keys(), 100);
+  for (int i = 0; i < 100; i += 3) m.remove(i);
+  for (int i = 0; i < 100; i++) EXPECT_EQ(m.has(i), i % 3 != 0);
+  for (int i = 0; i < 100; i++) m.remove(i);
+  EXPECT_EQ(m.get_n_keys(), 0);
+  m.add(5);
+  EXPECT_TRUE(m.has(5));
+}
+
+TEST(OMPHashSetTest, Reseed) {
+  // All the keys collide until the hasher is seeded, as if crafted against the default seed.
+  struct weak_hasher {
+    uint64_t seed;
+    weak_hasher() : seed(0) {}
+    explicit weak_hasher(const uint64_t seed) : seed(seed) {}
+    size_t operator()(const int key) const { return seed ? omp_hashing::fmix64(key ^ seed) : 0; }
+  };
+  omp_hash_set<int, weak_hasher> m;
+  for (int i = 0; i < 1000; i++) m.add(i);
+  EXPECT_NE(m.get_hash_seed(), 0);
+  EXPECT_EQ(m.get_n_keys(), 1000);
+  for (int i = 0; i < 1000; i++) EXPECT_TRUE(m.has(i));
+
+  m.set_hash_seed(12345);
+  EXPECT_EQ(m.get_hash_seed(), 12345);
+  for (int i = 0; i < 1000; i++) EXPECT_TRUE(m.has(i));
+}
+
 TEST(OMPHashSetTest, Apply) {
   omp_hash_set<std::string> m;
   m.add("aa");
@@ -140,4 +351,12 @@ TEST(OMPHashSetTest, Clear) {
   EXPECT_FALSE(m.has("aa"));
   EXPECT_FALSE(m.has("bbb"));
   EXPECT_EQ(m.get_n_keys(), 0);
+
+  // Clear after rehashing.
+  for (int i = 0; i < 1000; i++) m.add(std::to_string(i));
+  m.clear();
+  EXPECT_EQ(m.get_n_keys(), 0);
+  EXPECT_FALSE(m.has("999"));
+  m.add("999");
+  EXPECT_TRUE(m.has("999"));
 }
\ No newline at end of file
@@ -0,0 +1,111 @@
+#include "omp_hash.h"
+#include <algorithm>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "gtest/gtest.h"
+
+namespace {
+
+// Return the max number of keys in one of the power of two buckets.
+template <class H, class K>
+size_t get_max_bucket_size(const std::vector<K>& keys, const size_t n_buckets) {
+  std::vector<size_t> bucket_sizes(n_buckets, 0);
+  for (const auto& key : keys) bucket_sizes[H()(key) & (n_buckets - 1)]++;
+  return *std::max_element(bucket_sizes.begin(), bucket_sizes.end());
+}
+
+// Expect the batch hash values of the keys to equal their hash values one by one.
+template <class H, class K>
+void expect_batch_equal(const H& hasher, const std::vector<K>& keys) {
+  std::vector<size_t> hash_values(keys.size());
+  omp_hashing::hash_batch(hasher, keys.data(), keys.size(), hash_values.data());
+  for (size_t i = 0; i < keys.size(); i++) EXPECT_EQ(hash_values[i], hasher(keys[i]));
+}
+
+}  // namespace
+
+TEST(OMPHashTest, StridedIntegers) {
+  // Keys strided by the number of buckets all land in one bucket with the identity hash.
+  constexpr size_t N_BUCKETS = 1 << 12;
+  std::vector<long long> keys;
+  for (long long i = 0; i < 1 << 16; i++) keys.push_back(i * N_BUCKETS);
+  EXPECT_EQ(get_max_bucket_size<std::hash<long long>>(keys, N_BUCKETS), keys.size());
+  EXPECT_LT(get_max_bucket_size<omp_hash<long long>>(keys, N_BUCKETS), 48);
+
+  std::vector<int> sequential_keys;
+  for (int i = 0; i < 1 << 16; i++) sequential_keys.push_back(i);
+  EXPECT_LT(get_max_bucket_size<omp_hash<int>>(sequential_keys, N_BUCKETS), 48);
+}
+
+TEST(OMPHashTest, Strings) {
+  const omp_hash<std::string> hasher;
+  EXPECT_EQ(hasher("abc"), hasher(std::string("abc")));
+  EXPECT_NE(hasher("abc"), hasher("abd"));
+
+  // Every length goes through a different branch, and prefixes shall not collide.
+  std::unordered_set<size_t> hash_values;
+  std::string key;
+  for (int i = 0; i < 200; i++) {
+    hash_values.insert(hasher(key));
+    key.push_back('a' + i % 3);
+  }
+  EXPECT_EQ(hash_values.size(), 200);
+
+  // Keys differing in one byte spread over the buckets.
+  std::vector<std::string> keys;
+  for (int i = 0; i < 1 << 16; i++) keys.push_back("key_" + std::to_string(i));
+  EXPECT_LT(get_max_bucket_size<omp_hash<std::string>>(keys, 1 << 12), 48);
+}
+
+TEST(OMPHashTest, Seeds) {
+  // The default seed gives the unseeded hash values, and other seeds give different ones.
+  EXPECT_EQ(omp_hash<int>(0)(5), omp_hash<int>()(5));
+  EXPECT_NE(omp_hash<int>(1)(5), omp_hash<int>()(5));
+  EXPECT_NE(omp_hash<std::string>(1)("abc"), omp_hash<std::string>()("abc"));
+  EXPECT_NE(omp_hash<double>(1)(0.5), omp_hash<double>()(0.5));
+
+  // Keys colliding in the buckets under one seed spread under another.
+  std::vector<int> keys;
+  for (int i = 0; keys.size() < 1000; i++) {
+    if (omp_hash<int>()(i) % 1021 == 0) keys.push_back(i);
+  }
+  EXPECT_EQ(get_max_bucket_size<omp_hash<int>>(keys, 1), 1000);
+  std::unordered_set<size_t> bucket_ids;
+  for (const int key : keys) bucket_ids.insert(omp_hash<int>(12345)(key) % 1021);
+  EXPECT_GT(bucket_ids.size(), 500);
+}
+
+TEST(OMPHashTest, Fallback) {
+  // Other key types are mixed on top of std::hash.
+  const omp_hash<double> hasher;
+  EXPECT_EQ(hasher(0.5), omp_hashing::fmix64(std::hash<double>()(0.5)));
+  EXPECT_NE(hasher(0.5), hasher(1.5));
+}
+
+TEST(OMPHashTest, Batch) {
+  // The batch hash values equal the hash values of each key, including the tails of the vectors.
+  std::vector<int> int_keys;
+  std::vector<unsigned> unsigned_keys;
+  std::vector<long long> long_keys;
+  std::vector<short> short_keys;
+  std::vector<double> double_keys;
+  for (int i = -50; i < 51; i++) {
+    int_keys.push_back(i * 1000003);
+    unsigned_keys.push_back(static_cast<unsigned>(i) * 2654435761U);
+    long_keys.push_back(i * 1000000007LL);
+    short_keys.push_back(i * 7);
+    double_keys.push_back(i * 0.5);
+  }
+  expect_batch_equal(omp_hash<int>(), int_keys);
+  expect_batch_equal(omp_hash<int>(12345), int_keys);
+  expect_batch_equal(omp_hash<unsigned>(12345), unsigned_keys);
+  expect_batch_equal(omp_hash<long long>(12345), long_keys);
+  expect_batch_equal(omp_hash<short>(12345), short_keys);
+  expect_batch_equal(omp_hash<double>(12345), double_keys);
+
+  EXPECT_TRUE((omp_hashing::has_hash_batch<omp_hash<int>, int>::value));
+  EXPECT_FALSE((omp_hashing::has_hash_batch<std::hash<int>, int>::value));
+  const std::vector<std::string> string_keys = {"a", "b", "c"};
+  expect_batch_equal(omp_hash<std::string>(12345), string_keys);
+}
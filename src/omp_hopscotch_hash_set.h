@@ -0,0 +1,504 @@
+#ifndef OMP_HOPSCOTCH_HASH_SET_H_
+#define OMP_HOPSCOTCH_HASH_SET_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "first_touch.h"
+#include "lock.h"
+#include "omp.h"
+#include "omp_hash.h"
+#include "open_addressing.h"
+
+// A high performance concurrent hash set based on hopscotch hashing and OpenMP.
+// Every key lives within a small neighborhood of slots after its home slot, sized so that the
+// neighborhood of small keys spans one cache line, and a bitmap at the home slot tells which of
+// those slots hold its keys. A lookup scans only that neighborhood, even at high load factors.
+// An insertion takes the nearest free slot and hops it back into the neighborhood by moving other
+// keys within their own neighborhoods.
+// The segments are contiguous ranges of slots. An operation locks the segment of its home slot and
+// the next one, and falls back to a global operation, which has the whole table, if the insertion
+// runs beyond them.
+// K must be default constructible. H shall not map more than NEIGHBORHOOD_SIZE keys to the same
+// value, otherwise no table size can hold them and add() throws std::length_error, leaving the set
+// as it was.
+// L is the lock policy of the segments, one of those in lock.h.
+template <class K, class H = omp_hash<K>, class L = omp_lock>
+class omp_hopscotch_hash_set {
+ public:
+  // The slot array can be backed by huge pages to reduce TLB misses on large tables.
+  explicit omp_hopscotch_hash_set(const page_policy policy = page_policy::normal);
+
+  // Set the number of buckets (slots) in the container to be at least the specified value.
+  // Throw std::length_error, leaving the set as it was, if no table from that size up to
+  // MAX_N_GROWTHS doublings of it can hold the keys.
+  void reserve(const size_t n_buckets) {
+    const size_t n_rehashing_buckets = omp_open_addressing::get_n_rehashing_buckets(n_buckets);
+    rehash(n_rehashing_buckets);
+  };
+
+  // Return the number of buckets (slots).
+  size_t get_n_buckets() const { return n_buckets; };
+
+  // Return the current load factor (the ratio between the number of keys and buckets).
+  double get_load_factor() const { return static_cast<double>(get_n_keys()) / n_buckets; }
+
+  // Return the max load factor beyond which an automatic rehashing will occur.
+  double get_max_load_factor() const { return max_load_factor; }
+
+  // Set the max load factor beyond which an automatic rehashing will occur.
+  // It shall be less than one, since every key takes a slot.
+  void set_max_load_factor(const double max_load_factor) {
+    this->max_load_factor = max_load_factor;
+    is_near_max_load = true;
+  }
+
+  // Return the number of keys.
+  size_t get_n_keys() const { return segments.get_n_keys(); }
+
+  // Set the specified key.
+  void add(const K& key);
+
+  // Remove the specified key.
+  void remove(const K& key);
+
+  // Test if the specified key exists.
+  bool has(const K& key);
+
+  // Return the reduced value of the mapped values of all the keys.
+  // If no key exists, return the default value.
+  template <class W>
+  W map_reduce(
+      const std::function<W(const K&)>& mapper,
+      const std::function<void(W&, const W&)>& reducer,
+      const W& default_value);
+
+  // Apply the handler to all the keys.
+  void apply(const std::function<void(const K&)>& handler);
+
+  // Clear all keys.
+  void clear();
+
+ private:
+  size_t n_buckets;
+
+  double max_load_factor;
+
+  // Set once a segment holds its share of the max number of keys, after which every insert checks
+  // the number of keys summed over the segments. Only cleared within a global operation.
+  bool is_near_max_load;
+
+  H hasher;
+
+  page_policy policy;
+
+  // Larger than any neighborhood, so that a neighborhood never wraps onto itself.
+  constexpr static size_t N_INITIAL_BUCKETS = 47;
+
+  constexpr static size_t N_SEGMENTS_PER_THREAD = 7;
+
+  constexpr static double DEFAULT_MAX_LOAD_FACTOR = 0.9;
+
+  constexpr static size_t CACHE_LINE_SIZE = 64;
+
+  // Segments are at least this long, so that most insertions stay within two segments.
+  constexpr static size_t MIN_SEGMENT_SIZE = 64;
+
+  // The max distance from the home slot to the free slot taken by an insertion.
+  // Farther free slots grow the table.
+  constexpr static size_t MAX_PROBE_LENGTH = 256;
+
+  // The max number of consecutive growths for placing one key before giving up.
+  constexpr static size_t MAX_N_GROWTHS = 8;
+
+  // The entire hash set is divided into several segments (depends on how many threads), which are
+  // contiguous ranges of slots. A key is counted in the segment of its home slot.
+  omp_open_addressing::segment_locks<L> segments;
+
+  struct hash_slot {
+    K key;
+    // Bit i is set if the slot i after this one holds a key whose home slot is this one.
+    uint16_t hop_info;
+    bool occupied;
+    hash_slot() : hop_info(0), occupied(false){};
+  };
+
+  // The number of slots in a neighborhood, so that the neighborhood of small keys fills a cache
+  // line. Bounded by the width of hop_info. It is also the max number of keys of the same hash
+  // value, which share their home slot in any table size.
+  constexpr static size_t NEIGHBORHOOD_SIZE =
+      std::min<size_t>(16, std::max<size_t>(4, CACHE_LINE_SIZE / sizeof(hash_slot)));
+
+  first_touch_array<hash_slot> slots;
+
+  // Grow the slots for the max load factor, unless another thread has already grown them.
+  // A table which fails to grow stays as it is, beyond the max load factor.
+  void rehash_for_load();
+
+  void rehash(const size_t n_rehashing_buckets);
+
+  // Rehash into the specified number of slots, or into up to MAX_N_GROWTHS doublings of it if the
+  // keys do not fit. Return false, with the table as it was, if none fits.
+  // Must be called within a global operation.
+  bool grow_locked(size_t n_rehashing_buckets);
+
+  // Copy all the keys into a new slot array of the specified size. Return false, with the old slot
+  // array kept, if some key cannot be placed. Must be called within a global operation.
+  bool rehash_locked(const size_t n_rehashing_buckets);
+
+  size_t get_segment_size() const {
+    return omp_open_addressing::get_segment_size(n_buckets, segments.size(), MIN_SEGMENT_SIZE);
+  }
+
+  size_t get_window(const size_t home_id, size_t& segment_id_1, size_t& segment_id_2) const {
+    return omp_open_addressing::get_window(
+        home_id, n_buckets, get_segment_size(), segment_id_1, segment_id_2);
+  }
+
+  // Count a new key in the segment of its home slot. Return true if the keys of all the segments
+  // shall then be counted against the max load factor.
+  bool count_new_key(const size_t home_id);
+
+  // Test if the segment holds its share of the max number of keys.
+  bool is_segment_full(const size_t segment_id, const size_t n_segment_keys) const;
+
+  // Set is_near_max_load if any segment holds its share of the max number of keys.
+  // Must be called within a global operation.
+  void update_near_max_load();
+
+  // Lock the window of the key and apply window_handler to the home slot and the window length.
+  // If window_handler returns false, it is applied again within a global operation with a window
+  // spanning the whole table, growing the table until it returns true. Throw std::length_error,
+  // leaving the set as it was, if no growth helps.
+  // window_handler shall leave the table consistent when it returns false.
+  void hash_window_apply(
+      const K& key, const std::function<bool(const size_t, const size_t)>& window_handler);
+
+  // Apply node_handler to all the slots which hold a key.
+  void hash_node_apply(const std::function<void(hash_slot&)>& node_handler);
+
+  // Return the slot in the neighborhood of the home slot which has the key, or nullptr.
+  hash_slot* find_slot(const K& key, const size_t home_id);
+
+  // Insert the key into the neighborhood of the home slot, hopping the nearest free slot within the
+  // window back into the neighborhood. Return false if there is no such free slot or it cannot be
+  // hopped back, in which case some keys may have been moved within their neighborhoods.
+  bool insert_slot(K&& key, const size_t home_id, const size_t window_length);
+
+  // Return the number of keys of the specified hash value. Must be called within a global
+  // operation.
+  size_t count_keys_of_hash(const size_t hash_value);
+};
+
+template <class K, class H, class L>
+constexpr size_t omp_hopscotch_hash_set<K, H, L>::MAX_PROBE_LENGTH;
+
+template <class K, class H, class L>
+omp_hopscotch_hash_set<K, H, L>::omp_hopscotch_hash_set(const page_policy policy)
+    : policy(policy), segments(omp_get_max_threads() * N_SEGMENTS_PER_THREAD) {
+  n_buckets = N_INITIAL_BUCKETS;
+  slots = first_touch_array<hash_slot>(n_buckets, policy);
+  max_load_factor = DEFAULT_MAX_LOAD_FACTOR;
+  is_near_max_load = false;
+}
+
+template <class K, class H, class L>
+void omp_hopscotch_hash_set<K, H, L>::rehash_for_load() {
+  segments.begin_global_operation();
+  try {
+    const size_t n_keys = get_n_keys();
+    if (n_keys >= n_buckets * max_load_factor) {
+      grow_locked(omp_open_addressing::get_n_rehashing_buckets(n_keys / max_load_factor * 2));
+    }
+  } catch (...) {
+    segments.end_global_operation();
+    throw;
+  }
+  segments.end_global_operation();
+}
+
+template <class K, class H, class L>
+void omp_hopscotch_hash_set<K, H, L>::rehash(const size_t n_rehashing_buckets) {
+  segments.begin_global_operation();
+  bool is_rehashed;
+  try {
+    // No decrease in the number of buckets.
+    is_rehashed = n_buckets >= n_rehashing_buckets || grow_locked(n_rehashing_buckets);
+  } catch (...) {
+    segments.end_global_operation();
+    throw;
+  }
+  segments.end_global_operation();
+  if (!is_rehashed) throw std::length_error("too many keys with the same hash");
+}
+
+template <class K, class H, class L>
+bool omp_hopscotch_hash_set<K, H, L>::grow_locked(size_t n_rehashing_buckets) {
+  for (size_t n_growths = 0; !rehash_locked(n_rehashing_buckets); n_growths++) {
+    if (n_growths == MAX_N_GROWTHS) return false;
+    n_rehashing_buckets = omp_open_addressing::get_n_rehashing_buckets(n_rehashing_buckets * 2);
+  }
+  return true;
+}
+
+template <class K, class H, class L>
+bool omp_hopscotch_hash_set<K, H, L>::rehash_locked(const size_t n_rehashing_buckets) {
+  first_touch_array<hash_slot> rehashing_slots(n_rehashing_buckets, policy);
+  first_touch_array<hash_slot> old_slots = std::move(slots);
+  const size_t n_old_buckets = n_buckets;
+  slots = std::move(rehashing_slots);
+  n_buckets = n_rehashing_buckets;
+  const size_t segment_size = get_segment_size();
+  segments.reset_n_rehashed_keys();
+
+  // The keys are copied rather than moved, so that the old slots stay intact until all of them are
+  // placed. Keys whose insertion stays within their window are copied in parallel.
+  // The rest are inserted serially afterwards.
+  std::vector<std::vector<K>> thread_pending_keys(omp_get_max_threads());
+#pragma omp parallel for schedule(static)
+  for (size_t i = 0; i < n_old_buckets; i++) {
+    const hash_slot& old_slot = old_slots[i];
+    if (!old_slot.occupied) continue;
+    const size_t home_id = hasher(old_slot.key) % n_buckets;
+    size_t segment_id_1, segment_id_2;
+    const size_t window_length = get_window(home_id, segment_id_1, segment_id_2);
+    segments.lock_rehashing_pair(segment_id_1, segment_id_2);
+    const bool inserted = insert_slot(K(old_slot.key), home_id, window_length);
+    if (inserted) segments.add_n_rehashed_keys(home_id / segment_size);
+    segments.unlock_rehashing_pair(segment_id_1, segment_id_2);
+    if (!inserted) thread_pending_keys[omp_get_thread_num()].push_back(old_slot.key);
+  }
+  for (auto& pending_keys : thread_pending_keys) {
+    for (auto& key : pending_keys) {
+      const size_t home_id = hasher(key) % n_buckets;
+      if (!insert_slot(std::move(key), home_id, n_buckets)) {
+        slots = std::move(old_slots);
+        n_buckets = n_old_buckets;
+        return false;
+      }
+      segments.add_n_rehashed_keys(home_id / segment_size);
+    }
+  }
+  segments.commit_n_rehashed_keys();
+  update_near_max_load();
+  return true;
+}
+
+template <class K, class H, class L>
+bool omp_hopscotch_hash_set<K, H, L>::count_new_key(const size_t home_id) {
+  const size_t segment_id = home_id / get_segment_size();
+  if (!is_segment_full(segment_id, segments.add_n_keys(segment_id, 1))) return is_near_max_load;
+  is_near_max_load = true;
+  return true;
+}
+
+template <class K, class H, class L>
+bool omp_hopscotch_hash_set<K, H, L>::is_segment_full(
+    const size_t segment_id, const size_t n_segment_keys) const {
+  if (n_segment_keys == 0) return false;
+  // The last used segment may be shorter.
+  const size_t segment_size = get_segment_size();
+  const size_t n_segment_buckets = std::min(segment_size, n_buckets - segment_id * segment_size);
+  return n_segment_keys >= n_segment_buckets * max_load_factor;
+}
+
+template <class K, class H, class L>
+void omp_hopscotch_hash_set<K, H, L>::update_near_max_load() {
+  is_near_max_load = false;
+  for (size_t i = 0; i < segments.size(); i++) {
+    if (is_segment_full(i, segments.get_n_keys(i))) is_near_max_load = true;
+  }
+}
+
+template <class K, class H, class L>
+void omp_hopscotch_hash_set<K, H, L>::add(const K& key) {
+  bool is_near_full = false;
+  const auto& window_handler = [&](const size_t home_id, const size_t window_length) {
+    if (find_slot(key, home_id)) return true;
+    K new_key(key);
+    if (!insert_slot(std::move(new_key), home_id, window_length)) return false;
+    is_near_full = count_new_key(home_id);
+    return true;
+  };
+  hash_window_apply(key, window_handler);
+  if (is_near_full && get_n_keys() >= n_buckets * max_load_factor) rehash_for_load();
+}
+
+template <class K, class H, class L>
+void omp_hopscotch_hash_set<K, H, L>::remove(const K& key) {
+  const auto& window_handler = [&](const size_t home_id, const size_t) {
+    hash_slot* slot = find_slot(key, home_id);
+    if (!slot) return true;
+    const size_t offset = (slot - &slots[0] + n_buckets - home_id) % n_buckets;
+    slots[home_id].hop_info &= ~(1 << offset);
+    slot->key = K();
+    slot->occupied = false;
+    segments.add_n_keys(home_id / get_segment_size(), -1);
+    return true;
+  };
+  hash_window_apply(key, window_handler);
+}
+
+template <class K, class H, class L>
+bool omp_hopscotch_hash_set<K, H, L>::has(const K& key) {
+  bool has_key = false;
+  const auto& window_handler = [&](const size_t home_id, const size_t) {
+    has_key = find_slot(key, home_id) != nullptr;
+    return true;
+  };
+  hash_window_apply(key, window_handler);
+  return has_key;
+}
+
+template <class K, class H, class L>
+template <class W>
+W omp_hopscotch_hash_set<K, H, L>::map_reduce(
+    const std::function<W(const K&)>& mapper,
+    const std::function<void(W&, const W&)>& reducer,
+    const W& default_value) {
+  std::vector<W> thread_reduced_values(omp_get_max_threads(), default_value);
+  W reduced_value = default_value;
+  const auto& node_handler = [&](hash_slot& slot) {
+    const size_t thread_id = omp_get_thread_num();
+    const W& mapped_value = mapper(slot.key);
+    reducer(thread_reduced_values[thread_id], mapped_value);
+  };
+  hash_node_apply(node_handler);
+  for (const auto& value : thread_reduced_values) reducer(reduced_value, value);
+  return reduced_value;
+}
+
+template <class K, class H, class L>
+void omp_hopscotch_hash_set<K, H, L>::apply(const std::function<void(const K&)>& handler) {
+  const auto& node_handler = [&](hash_slot& slot) { handler(slot.key); };
+  hash_node_apply(node_handler);
+}
+
+template <class K, class H, class L>
+void omp_hopscotch_hash_set<K, H, L>::clear() {
+  first_touch_array<hash_slot> initial_slots(N_INITIAL_BUCKETS, policy);
+  segments.begin_global_operation();
+  slots = std::move(initial_slots);
+  n_buckets = N_INITIAL_BUCKETS;
+  segments.clear_n_keys();
+  is_near_max_load = false;
+  segments.end_global_operation();
+}
+
+template <class K, class H, class L>
+void omp_hopscotch_hash_set<K, H, L>::hash_window_apply(
+    const K& key, const std::function<bool(const size_t, const size_t)>& window_handler) {
+  const size_t hash_value = hasher(key);
+  while (true) {
+    // The slots only change within a global operation.
+    const size_t version = segments.wait_for_global_operation();
+    const size_t home_id = hash_value % n_buckets;
+    size_t segment_id_1, segment_id_2;
+    const size_t window_length = get_window(home_id, segment_id_1, segment_id_2);
+    if (!segments.lock_pair(segment_id_1, segment_id_2, version)) continue;
+    const bool applied = window_handler(home_id, window_length);
+    segments.unlock_pair(segment_id_1, segment_id_2);
+    if (applied) return;
+    break;
+  }
+
+  // Slow path: the insertion runs beyond the two segments or the neighborhood is crowded.
+  segments.begin_global_operation();
+  try {
+    for (size_t n_growths = 0; !window_handler(hash_value % n_buckets, n_buckets); n_growths++) {
+      // No table size helps once the keys of the hash value fill the neighborhood.
+      if (n_growths == MAX_N_GROWTHS || count_keys_of_hash(hash_value) >= NEIGHBORHOOD_SIZE ||
+          !grow_locked(omp_open_addressing::get_n_rehashing_buckets(n_buckets * 2))) {
+        throw std::length_error("too many keys with the same hash");
+      }
+    }
+  } catch (...) {
+    segments.end_global_operation();
+    throw;
+  }
+  segments.end_global_operation();
+}
+
+template <class K, class H, class L>
+void omp_hopscotch_hash_set<K, H, L>::hash_node_apply(
+    const std::function<void(hash_slot&)>& node_handler) {
+  segments.begin_global_operation();
+#pragma omp parallel for schedule(static)
+  for (size_t i = 0; i < n_buckets; i++) {
+    if (slots[i].occupied) node_handler(slots[i]);
+  }
+  segments.end_global_operation();
+}
+
+template <class K, class H, class L>
+typename omp_hopscotch_hash_set<K, H, L>::hash_slot* omp_hopscotch_hash_set<K, H, L>::find_slot(
+    const K& key, const size_t home_id) {
+  const uint16_t hop_info = slots[home_id].hop_info;
+  for (size_t i = 0; i < NEIGHBORHOOD_SIZE; i++) {
+    if (!(hop_info & (1 << i))) continue;
+    hash_slot& slot = slots[(home_id + i) % n_buckets];
+    if (slot.key == key) return &slot;
+  }
+  return nullptr;
+}
+
+template <class K, class H, class L>
+bool omp_hopscotch_hash_set<K, H, L>::insert_slot(
+    K&& key, const size_t home_id, const size_t window_length) {
+  // Find the nearest free slot.
+  const size_t max_offset = std::min(MAX_PROBE_LENGTH, window_length);
+  size_t free_offset = 0;
+  while (slots[(home_id + free_offset) % n_buckets].occupied) {
+    free_offset++;
+    if (free_offset >= max_offset) return false;
+  }
+
+  // Hop the free slot back into the neighborhood of the home slot. Each hop moves the earliest key
+  // of a preceding neighborhood which covers the free slot into it.
+  while (free_offset >= NEIGHBORHOOD_SIZE) {
+    bool hopped = false;
+    for (size_t offset = free_offset - NEIGHBORHOOD_SIZE + 1; offset < free_offset && !hopped;
+         offset++) {
+      hash_slot& neighborhood_home = slots[(home_id + offset) % n_buckets];
+      for (size_t i = 0; offset + i < free_offset; i++) {
+        if (!(neighborhood_home.hop_info & (1 << i))) continue;
+        hash_slot& from = slots[(home_id + offset + i) % n_buckets];
+        hash_slot& to = slots[(home_id + free_offset) % n_buckets];
+        to.key = std::move(from.key);
+        to.occupied = true;
+        from.key = K();
+        from.occupied = false;
+        neighborhood_home.hop_info &= ~(1 << i);
+        neighborhood_home.hop_info |= 1 << (free_offset - offset);
+        free_offset = offset + i;
+        hopped = true;
+        break;
+      }
+    }
+    if (!hopped) return false;
+  }
+
+  hash_slot& slot = slots[(home_id + free_offset) % n_buckets];
+  slot.key = std::move(key);
+  slot.occupied = true;
+  slots[home_id].hop_info |= 1 << free_offset;
+  return true;
+}
+
+template <class K, class H, class L>
+size_t omp_hopscotch_hash_set<K, H, L>::count_keys_of_hash(const size_t hash_value) {
+  const size_t home_id = hash_value % n_buckets;
+  const uint16_t hop_info = slots[home_id].hop_info;
+  size_t n_keys = 0;
+  for (size_t i = 0; i < NEIGHBORHOOD_SIZE; i++) {
+    if ((hop_info & (1 << i)) && hasher(slots[(home_id + i) % n_buckets].key) == hash_value) {
+      n_keys++;
+    }
+  }
+  return n_keys;
+}
+
+#endif
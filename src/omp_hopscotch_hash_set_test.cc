@@ -0,0 +1,202 @@
+#include "omp_hopscotch_hash_set.h"
+#include "gtest/gtest.h"
+#include "omp.h"
+#include "reducer.h"
+
+namespace {
+
+// Every four keys share a hash value, so the free slots are often beyond the neighborhood and have
+// to be hopped back.
+struct coarse_hasher {
+  size_t operator()(const int key) const { return (key / 4) * 2654435761ULL; }
+};
+
+// Maps every key to the same value, which no table size can hold more keys of than a neighborhood.
+struct constant_hasher {
+  size_t operator()(const int) const { return 0; }
+};
+
+// Hashes as omp_hash while is_constant is false, and as constant_hasher otherwise, so that a test
+// can make the keys of a set collide in any larger table.
+struct switchable_hasher {
+  static bool is_constant;
+  size_t operator()(const int key) const { return is_constant ? 0 : omp_hash<int>()(key); }
+};
+
+bool switchable_hasher::is_constant = false;
+
+}  // namespace
+
+TEST(OMPHopscotchHashSetTest, Initialization) {
+  omp_hopscotch_hash_set<std::string> m;
+  EXPECT_EQ(m.get_n_keys(), 0);
+  EXPECT_EQ(m.get_max_load_factor(), 0.9);
+}
+
+TEST(OMPHopscotchHashSetTest, Reserve) {
+  omp_hopscotch_hash_set<std::string> m;
+  m.reserve(1000);
+  EXPECT_GE(m.get_n_buckets(), 1000);
+
+  // Automatic reserve tests.
+  omp_hopscotch_hash_set<int> m2;
+  for (int i = 0; i < 1000; i++) {
+    m2.add(i);
+    EXPECT_EQ(m2.get_n_keys(), i + 1);
+    EXPECT_LT(m2.get_load_factor(), m2.get_max_load_factor());
+  }
+  for (int i = 0; i < 1000; i++) EXPECT_TRUE(m2.has(i));
+}
+
+TEST(OMPHopscotchHashSetTest, AddAndRemove) {
+  omp_hopscotch_hash_set<std::string> m;
+  m.add("aa");
+  m.add("aa");
+  m.add("bbb");
+  EXPECT_EQ(m.get_n_keys(), 2);
+  EXPECT_TRUE(m.has("aa"));
+  EXPECT_FALSE(m.has("not_exist_key"));
+
+  m.remove("aa");
+  m.remove("not_exist_key");
+  EXPECT_FALSE(m.has("aa"));
+  EXPECT_TRUE(m.has("bbb"));
+  EXPECT_EQ(m.get_n_keys(), 1);
+}
+
+TEST(OMPHopscotchHashSetTest, Hopping) {
+  omp_hopscotch_hash_set<int, coarse_hasher> m;
+  for (int i = 0; i < 1000; i++) m.add(i);
+  EXPECT_EQ(m.get_n_keys(), 1000);
+  for (int i = 0; i < 1000; i += 3) m.remove(i);
+  for (int i = 0; i < 1000; i++) EXPECT_EQ(m.has(i), i % 3 != 0);
+  for (int i = 0; i < 1000; i++) m.remove(i);
+  EXPECT_EQ(m.get_n_keys(), 0);
+}
+
+TEST(OMPHopscotchHashSetTest, NeighborhoodLimit) {
+  // No table size can hold more keys with the same hash value than a neighborhood, so the next one
+  // throws without growing the table.
+  omp_hopscotch_hash_set<int, constant_hasher> m;
+  int n_keys = 0;
+  size_t n_buckets = 0;
+  EXPECT_THROW(
+      {
+        for (; n_keys < 100; n_keys++) {
+          n_buckets = m.get_n_buckets();
+          m.add(n_keys);
+        }
+      },
+      std::length_error);
+  EXPECT_GE(n_keys, 4);
+  EXPECT_LE(n_keys, 16);
+  EXPECT_EQ(m.get_n_buckets(), n_buckets);
+  EXPECT_EQ(m.get_n_keys(), n_keys);
+  EXPECT_FALSE(m.has(n_keys));
+  for (int i = 0; i < n_keys; i++) EXPECT_TRUE(m.has(i));
+
+  // The locks are released, so the set takes further updates.
+  m.remove(0);
+  m.add(n_keys);
+  EXPECT_TRUE(m.has(n_keys));
+  EXPECT_EQ(m.get_n_keys(), n_keys);
+}
+
+TEST(OMPHopscotchHashSetTest, FailedRehashKeepsSet) {
+  omp_hopscotch_hash_set<int, switchable_hasher> m;
+  for (int i = 0; i < 100; i++) m.add(i);
+  const size_t n_buckets = m.get_n_buckets();
+
+  // No larger table holds 100 keys of one hash value, so the rehash restores the old slots.
+  switchable_hasher::is_constant = true;
+  EXPECT_THROW(m.reserve(n_buckets * 4), std::length_error);
+  switchable_hasher::is_constant = false;
+  EXPECT_EQ(m.get_n_buckets(), n_buckets);
+  EXPECT_EQ(m.get_n_keys(), 100);
+  for (int i = 0; i < 100; i++) EXPECT_TRUE(m.has(i));
+  m.reserve(n_buckets * 4);
+  EXPECT_GE(m.get_n_buckets(), n_buckets * 4);
+  for (int i = 0; i < 100; i++) EXPECT_TRUE(m.has(i));
+}
+
+TEST(OMPHopscotchHashSetTest, MapReduceAndApply) {
+  omp_hopscotch_hash_set<int> m;
+#pragma omp parallel for
+  for (int i = 0; i < 1000; i++) m.add(i);
+  EXPECT_EQ(m.get_n_keys(), 1000);
+  const auto& mapper = [](const int key) { return key; };
+  EXPECT_EQ(m.map_reduce<int>(mapper, reducer::sum<int>, 0), 499500);
+  int sum = 0;
+  m.apply([&](const int key) {
+#pragma omp atomic
+    sum += key;
+  });
+  EXPECT_EQ(sum, 499500);
+
+  m.clear();
+  EXPECT_EQ(m.get_n_keys(), 0);
+  EXPECT_FALSE(m.has(5));
+}
+
+TEST(OMPHopscotchHashSetTest, MoreThreadsThanAtConstruction) {
+  // The buffers of each thread follow the number of threads at the time of use.
+  omp_hopscotch_hash_set<int> m;
+  const int n_threads = omp_get_max_threads();
+  omp_set_num_threads(n_threads * 4);
+#pragma omp parallel for
+  for (int i = 0; i < 100000; i++) m.add(i);
+  EXPECT_EQ(m.get_n_keys(), 100000);
+  const auto& mapper = [](const int key) { return key; };
+  EXPECT_EQ(m.map_reduce<long long>(mapper, reducer::sum<long long>, 0), 4999950000LL);
+  omp_set_num_threads(n_threads);
+}
+
+namespace {
+
+// Concurrent insertions and removals of colliding keys, with more threads than at the construction,
+// so that the hops and the rehashes run as global operations among them.
+template <class L>
+void update_concurrently() {
+  omp_hopscotch_hash_set<int, coarse_hasher, L> m;
+  const int n_threads = omp_get_max_threads();
+  omp_set_num_threads(n_threads * 4);
+#pragma omp parallel for
+  for (int i = 0; i < 100000; i++) {
+    m.add(i);
+    m.add(i);
+    if (i % 2 == 0) m.remove(i);
+  }
+  omp_set_num_threads(n_threads);
+  EXPECT_EQ(m.get_n_keys(), 50000);
+  EXPECT_LE(m.get_load_factor(), m.get_max_load_factor());
+  const auto& mapper = [](const int key) { return key; };
+  EXPECT_EQ(m.template map_reduce<long long>(mapper, reducer::sum<long long>, 0), 2500000000LL);
+}
+
+}  // namespace
+
+TEST(OMPHopscotchHashSetTest, ConcurrentUpdates) { update_concurrently<omp_lock>(); }
+
+TEST(OMPHopscotchHashSetTest, ConcurrentUpdatesWithSpinLock) { update_concurrently<spin_lock>(); }
+
+TEST(OMPHopscotchHashSetTest, ConcurrentUpdatesWithFutexLock) {
+  update_concurrently<futex_lock>();
+}
+
+TEST(OMPHopscotchHashSetLargeTest, TenMillionsHas) {
+  omp_hopscotch_hash_set<long long> m;
+  constexpr long long LARGE_N_KEYS = 10000000;
+
+  omp_set_nested(1);  // Parallel rehashing.
+#pragma omp parallel for
+  for (long long i = 0; i < LARGE_N_KEYS; i++) {
+    m.add(i * 7919);
+  }
+  EXPECT_EQ(m.get_n_keys(), LARGE_N_KEYS);
+  long long n_found = 0;
+#pragma omp parallel for reduction(+ : n_found)
+  for (long long i = 0; i < LARGE_N_KEYS; i++) {
+    n_found += m.has(i * 7919) + m.has(i * 7919 + 1);
+  }
+  EXPECT_EQ(n_found, LARGE_N_KEYS);
+}
@@ -0,0 +1,609 @@
+#ifndef OMP_ROBIN_HOOD_HASH_MAP_H_
+#define OMP_ROBIN_HOOD_HASH_MAP_H_
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "first_touch.h"
+#include "lock.h"
+#include "omp.h"
+#include "omp_hash.h"
+#include "open_addressing.h"
+
+// A high performance concurrent hash map based on Robin Hood open addressing and OpenMP.
+// Keys are kept in one flat slot array with linear probing. An insertion takes the slot of any key
+// which is closer to its home slot, so the probe lengths stay short and even at high load factors,
+// and a lookup of a missing key stops at the first key closer to its home than the probe is.
+// Removals shift the following keys backward, so no tombstones accumulate.
+// The segments are contiguous ranges of slots. An operation locks the segment of its home slot and
+// the next one, and falls back to a global operation, which has the whole table, if the probe runs
+// beyond them.
+// K and V must be default constructible. H shall not map more than MAX_PROBE_LENGTH (255) keys to
+// the same value, otherwise no table size can hold them and set() throws std::length_error, leaving
+// the map as it was.
+// L is the lock policy of the segments, one of those in lock.h.
+template <class K, class V, class H = omp_hash<K>, class L = omp_lock>
+class omp_robin_hood_hash_map {
+ public:
+  // The slot array can be backed by huge pages to reduce TLB misses on large tables.
+  explicit omp_robin_hood_hash_map(const page_policy policy = page_policy::normal);
+
+  // Set the number of buckets (slots) in the container to be at least the specified value.
+  // Throw std::length_error, leaving the map as it was, if no table from that size up to
+  // MAX_N_GROWTHS doublings of it can hold the keys.
+  void reserve(const size_t n_buckets) {
+    const size_t n_rehashing_buckets = omp_open_addressing::get_n_rehashing_buckets(n_buckets);
+    rehash(n_rehashing_buckets);
+  };
+
+  // Return the number of buckets (slots).
+  size_t get_n_buckets() const { return n_buckets; };
+
+  // Return the current load factor (the ratio between the number of keys and buckets).
+  double get_load_factor() const { return static_cast<double>(get_n_keys()) / n_buckets; }
+
+  // Return the max load factor beyond which an automatic rehashing will occur.
+  double get_max_load_factor() const { return max_load_factor; }
+
+  // Set the max load factor beyond which an automatic rehashing will occur.
+  // It shall be less than one, since every key takes a slot.
+  void set_max_load_factor(const double max_load_factor) {
+    this->max_load_factor = max_load_factor;
+    is_near_max_load = true;
+  }
+
+  // Return the number of keys.
+  size_t get_n_keys() const { return segments.get_n_keys(); }
+
+  // Set the specified key to the specified value.
+  void set(const K& key, const V& value);
+
+  // Update the value of the specified key.
+  // If the key does not exist, construct it with the default initializer first.
+  void set(const K& key, const std::function<void(V&)>& setter);
+
+  // Update the value of the specified key.
+  // If the key does not exist, construct and set it to the default value passed in first.
+  void set(const K& key, const std::function<void(V&)>& setter, const V& default_value);
+
+  // Remove the specified key.
+  void unset(const K& key);
+
+  // Test if the specified key exists.
+  bool has(const K& key);
+
+  // Return a copy of the value of the specified key, or the default value if key does not exist.
+  V get_copy_or_default(const K& key, const V& default_value);
+
+  // Return the mapped value for the value of the specified key.
+  // If the key does not exist, return the default value.
+  template <class W>
+  W map(const K& key, const std::function<W(const V&)>& mapper, const W& default_value);
+
+  // Return the reduced value of the mapped values of all the keys.
+  // If no key exists, return the default value.
+  template <class W>
+  W map_reduce(
+      const std::function<W(const K&, const V&)>& mapper,
+      const std::function<void(W&, const W&)>& reducer,
+      const W& default_value);
+
+  // Apply the handler to the value of the specific key, if it exists.
+  void apply(const K& key, const std::function<void(const V&)>& handler);
+
+  // Apply the handler to all the keys.
+  void apply(const std::function<void(const K&, const V&)>& handler);
+
+  // Clear all keys.
+  void clear();
+
+ private:
+  size_t n_buckets;
+
+  double max_load_factor;
+
+  // Set once a segment holds its share of the max number of keys, after which every insert checks
+  // the number of keys summed over the segments. Only cleared within a global operation.
+  bool is_near_max_load;
+
+  H hasher;
+
+  page_policy policy;
+
+  constexpr static size_t N_INITIAL_BUCKETS = 11;
+
+  constexpr static size_t N_SEGMENTS_PER_THREAD = 7;
+
+  constexpr static double DEFAULT_MAX_LOAD_FACTOR = 0.9;
+
+  // Segments are at least this long, so that most probes stay within two segments.
+  constexpr static size_t MIN_SEGMENT_SIZE = 64;
+
+  // The max distance from the home slot plus one. Longer probes grow the table, except for the keys
+  // of the same hash value, which share their home slot in any table size.
+  constexpr static size_t MAX_PROBE_LENGTH = 255;
+
+  // The max number of consecutive growths for placing one key before giving up.
+  constexpr static size_t MAX_N_GROWTHS = 8;
+
+  // The entire hash map is divided into several segments (depends on how many threads), which are
+  // contiguous ranges of slots. A key is counted in the segment of its home slot.
+  omp_open_addressing::segment_locks<L> segments;
+
+  struct hash_slot {
+    K key;
+    V value;
+    // The distance from the home slot plus one, or zero if the slot is empty.
+    unsigned char probe_length;
+    hash_slot() : probe_length(0){};
+  };
+
+  enum class probe_status { found, not_found, out_of_window };
+
+  first_touch_array<hash_slot> slots;
+
+  // Grow the slots for the max load factor, unless another thread has already grown them.
+  // A table which fails to grow stays as it is, beyond the max load factor.
+  void rehash_for_load();
+
+  void rehash(const size_t n_rehashing_buckets);
+
+  // Rehash into the specified number of slots, or into up to MAX_N_GROWTHS doublings of it if the
+  // keys do not fit. Return false, with the table as it was, if none fits.
+  // Must be called within a global operation.
+  bool grow_locked(size_t n_rehashing_buckets);
+
+  // Copy all the keys into a new slot array of the specified size. Return false, with the old slot
+  // array kept, if some key cannot be placed. Must be called within a global operation.
+  bool rehash_locked(const size_t n_rehashing_buckets);
+
+  size_t get_segment_size() const {
+    return omp_open_addressing::get_segment_size(n_buckets, segments.size(), MIN_SEGMENT_SIZE);
+  }
+
+  size_t get_window(const size_t home_id, size_t& segment_id_1, size_t& segment_id_2) const {
+    return omp_open_addressing::get_window(
+        home_id, n_buckets, get_segment_size(), segment_id_1, segment_id_2);
+  }
+
+  // Count a new key in the segment of its home slot. Return true if the keys of all the segments
+  // shall then be counted against the max load factor.
+  bool count_new_key(const size_t home_id);
+
+  // Test if the segment holds its share of the max number of keys.
+  bool is_segment_full(const size_t segment_id, const size_t n_segment_keys) const;
+
+  // Set is_near_max_load if any segment holds its share of the max number of keys.
+  // Must be called within a global operation.
+  void update_near_max_load();
+
+  // Lock the window of the key and apply window_handler to the home slot and the window length.
+  // If window_handler returns false, it is applied again within a global operation with a window
+  // spanning the whole table, growing the table until it returns true. Throw std::length_error,
+  // leaving the map as it was, if no growth helps.
+  // window_handler shall not modify any slot when it returns false.
+  void hash_window_apply(
+      const K& key, const std::function<bool(const size_t, const size_t)>& window_handler);
+
+  // Apply node_handler to the slot which has the key, or nullptr if the key does not exist.
+  void hash_node_apply(const K& key, const std::function<void(hash_slot*)>& node_handler);
+
+  // Apply node_handler to all the slots which hold a key.
+  void hash_node_apply(const std::function<void(hash_slot&)>& node_handler);
+
+  // Apply node_handler to the slot of the key, which is inserted with a default value first if it
+  // does not exist. The second argument of node_handler tells whether the key is new.
+  void hash_node_insert_apply(
+      const K& key, const std::function<void(hash_slot&, const bool)>& node_handler);
+
+  // Probe for the key within the window. Set offset to the distance of the key from its home slot
+  // if found, otherwise to the distance of the slot where the key would be inserted.
+  probe_status find_slot(
+      const K& key, const size_t home_id, const size_t window_length, size_t& offset);
+
+  // Insert the key at the specified distance from its home slot, shifting the following keys
+  // forward. Return false without any change if the shift runs beyond the window or too far.
+  bool insert_slot(
+      hash_slot&& slot, const size_t home_id, const size_t window_length, const size_t offset);
+
+  // Remove the key at the specified distance from its home slot, shifting the following keys
+  // backward. Return false without any change if the shift runs beyond the window.
+  bool erase_slot(const size_t home_id, const size_t window_length, const size_t offset);
+
+  // Return the number of keys of the specified hash value. Must be called within a global
+  // operation.
+  size_t count_keys_of_hash(const size_t hash_value);
+};
+
+template <class K, class V, class H, class L>
+omp_robin_hood_hash_map<K, V, H, L>::omp_robin_hood_hash_map(const page_policy policy)
+    : policy(policy), segments(omp_get_max_threads() * N_SEGMENTS_PER_THREAD) {
+  n_buckets = N_INITIAL_BUCKETS;
+  slots = first_touch_array<hash_slot>(n_buckets, policy);
+  max_load_factor = DEFAULT_MAX_LOAD_FACTOR;
+  is_near_max_load = false;
+}
+
+template <class K, class V, class H, class L>
+void omp_robin_hood_hash_map<K, V, H, L>::rehash_for_load() {
+  segments.begin_global_operation();
+  try {
+    const size_t n_keys = get_n_keys();
+    if (n_keys >= n_buckets * max_load_factor) {
+      grow_locked(omp_open_addressing::get_n_rehashing_buckets(n_keys / max_load_factor * 2));
+    }
+  } catch (...) {
+    segments.end_global_operation();
+    throw;
+  }
+  segments.end_global_operation();
+}
+
+template <class K, class V, class H, class L>
+void omp_robin_hood_hash_map<K, V, H, L>::rehash(const size_t n_rehashing_buckets) {
+  segments.begin_global_operation();
+  bool is_rehashed;
+  try {
+    // No decrease in the number of buckets.
+    is_rehashed = n_buckets >= n_rehashing_buckets || grow_locked(n_rehashing_buckets);
+  } catch (...) {
+    segments.end_global_operation();
+    throw;
+  }
+  segments.end_global_operation();
+  if (!is_rehashed) throw std::length_error("too many keys with the same hash");
+}
+
+template <class K, class V, class H, class L>
+bool omp_robin_hood_hash_map<K, V, H, L>::grow_locked(size_t n_rehashing_buckets) {
+  for (size_t n_growths = 0; !rehash_locked(n_rehashing_buckets); n_growths++) {
+    if (n_growths == MAX_N_GROWTHS) return false;
+    n_rehashing_buckets = omp_open_addressing::get_n_rehashing_buckets(n_rehashing_buckets * 2);
+  }
+  return true;
+}
+
+template <class K, class V, class H, class L>
+bool omp_robin_hood_hash_map<K, V, H, L>::rehash_locked(const size_t n_rehashing_buckets) {
+  first_touch_array<hash_slot> rehashing_slots(n_rehashing_buckets, policy);
+  first_touch_array<hash_slot> old_slots = std::move(slots);
+  const size_t n_old_buckets = n_buckets;
+  slots = std::move(rehashing_slots);
+  n_buckets = n_rehashing_buckets;
+  const size_t segment_size = get_segment_size();
+  segments.reset_n_rehashed_keys();
+
+  // The keys are copied rather than moved, so that the old slots stay intact until all of them are
+  // placed. Keys whose probe stays within their window are copied in parallel.
+  // The rest are inserted serially afterwards.
+  std::vector<std::vector<hash_slot>> thread_pending_slots(omp_get_max_threads());
+#pragma omp parallel for schedule(static)
+  for (size_t i = 0; i < n_old_buckets; i++) {
+    const hash_slot& old_slot = old_slots[i];
+    if (old_slot.probe_length == 0) continue;
+    const size_t home_id = hasher(old_slot.key) % n_buckets;
+    size_t segment_id_1, segment_id_2;
+    const size_t window_length = get_window(home_id, segment_id_1, segment_id_2);
+    segments.lock_rehashing_pair(segment_id_1, segment_id_2);
+    size_t offset;
+    const probe_status status = find_slot(old_slot.key, home_id, window_length, offset);
+    const bool inserted = status == probe_status::not_found &&
+                          insert_slot(hash_slot(old_slot), home_id, window_length, offset);
+    if (inserted) segments.add_n_rehashed_keys(home_id / segment_size);
+    segments.unlock_rehashing_pair(segment_id_1, segment_id_2);
+    if (!inserted) thread_pending_slots[omp_get_thread_num()].push_back(old_slot);
+  }
+  for (auto& pending_slots : thread_pending_slots) {
+    for (auto& slot : pending_slots) {
+      const size_t home_id = hasher(slot.key) % n_buckets;
+      size_t offset;
+      find_slot(slot.key, home_id, n_buckets, offset);
+      if (!insert_slot(std::move(slot), home_id, n_buckets, offset)) {
+        slots = std::move(old_slots);
+        n_buckets = n_old_buckets;
+        return false;
+      }
+      segments.add_n_rehashed_keys(home_id / segment_size);
+    }
+  }
+  segments.commit_n_rehashed_keys();
+  update_near_max_load();
+  return true;
+}
+
+template <class K, class V, class H, class L>
+bool omp_robin_hood_hash_map<K, V, H, L>::count_new_key(const size_t home_id) {
+  const size_t segment_id = home_id / get_segment_size();
+  if (!is_segment_full(segment_id, segments.add_n_keys(segment_id, 1))) return is_near_max_load;
+  is_near_max_load = true;
+  return true;
+}
+
+template <class K, class V, class H, class L>
+bool omp_robin_hood_hash_map<K, V, H, L>::is_segment_full(
+    const size_t segment_id, const size_t n_segment_keys) const {
+  if (n_segment_keys == 0) return false;
+  // The last used segment may be shorter.
+  const size_t segment_size = get_segment_size();
+  const size_t n_segment_buckets = std::min(segment_size, n_buckets - segment_id * segment_size);
+  return n_segment_keys >= n_segment_buckets * max_load_factor;
+}
+
+template <class K, class V, class H, class L>
+void omp_robin_hood_hash_map<K, V, H, L>::update_near_max_load() {
+  is_near_max_load = false;
+  for (size_t i = 0; i < segments.size(); i++) {
+    if (is_segment_full(i, segments.get_n_keys(i))) is_near_max_load = true;
+  }
+}
+
+template <class K, class V, class H, class L>
+void omp_robin_hood_hash_map<K, V, H, L>::set(const K& key, const V& value) {
+  const auto& node_handler = [&](hash_slot& slot, const bool) { slot.value = value; };
+  hash_node_insert_apply(key, node_handler);
+}
+
+template <class K, class V, class H, class L>
+void omp_robin_hood_hash_map<K, V, H, L>::set(
+    const K& key, const std::function<void(V&)>& setter) {
+  const auto& node_handler = [&](hash_slot& slot, const bool) { setter(slot.value); };
+  hash_node_insert_apply(key, node_handler);
+}
+
+template <class K, class V, class H, class L>
+void omp_robin_hood_hash_map<K, V, H, L>::set(
+    const K& key, const std::function<void(V&)>& setter, const V& default_value) {
+  const auto& node_handler = [&](hash_slot& slot, const bool is_new) {
+    if (is_new) slot.value = default_value;
+    setter(slot.value);
+  };
+  hash_node_insert_apply(key, node_handler);
+}
+
+template <class K, class V, class H, class L>
+void omp_robin_hood_hash_map<K, V, H, L>::unset(const K& key) {
+  const auto& window_handler = [&](const size_t home_id, const size_t window_length) {
+    size_t offset;
+    const probe_status status = find_slot(key, home_id, window_length, offset);
+    if (status == probe_status::out_of_window) return false;
+    if (status == probe_status::not_found) return true;
+    if (!erase_slot(home_id, window_length, offset)) return false;
+    segments.add_n_keys(home_id / get_segment_size(), -1);
+    return true;
+  };
+  hash_window_apply(key, window_handler);
+}
+
+template <class K, class V, class H, class L>
+bool omp_robin_hood_hash_map<K, V, H, L>::has(const K& key) {
+  bool has_key = false;
+  const auto& node_handler = [&](hash_slot* slot) {
+    if (slot) has_key = true;
+  };
+  hash_node_apply(key, node_handler);
+  return has_key;
+}
+
+template <class K, class V, class H, class L>
+V omp_robin_hood_hash_map<K, V, H, L>::get_copy_or_default(const K& key, const V& default_value) {
+  V value(default_value);
+  const auto& node_handler = [&](hash_slot* slot) {
+    if (slot) value = slot->value;
+  };
+  hash_node_apply(key, node_handler);
+  return value;
+}
+
+template <class K, class V, class H, class L>
+template <class W>
+W omp_robin_hood_hash_map<K, V, H, L>::map(
+    const K& key, const std::function<W(const V&)>& mapper, const W& default_value) {
+  W mapped_value(default_value);
+  const auto& node_handler = [&](hash_slot* slot) {
+    if (slot) mapped_value = mapper(slot->value);
+  };
+  hash_node_apply(key, node_handler);
+  return mapped_value;
+}
+
+template <class K, class V, class H, class L>
+template <class W>
+W omp_robin_hood_hash_map<K, V, H, L>::map_reduce(
+    const std::function<W(const K&, const V&)>& mapper,
+    const std::function<void(W&, const W&)>& reducer,
+    const W& default_value) {
+  std::vector<W> thread_reduced_values(omp_get_max_threads(), default_value);
+  W reduced_value = default_value;
+  const auto& node_handler = [&](hash_slot& slot) {
+    const size_t thread_id = omp_get_thread_num();
+    const W& mapped_value = mapper(slot.key, slot.value);
+    reducer(thread_reduced_values[thread_id], mapped_value);
+  };
+  hash_node_apply(node_handler);
+  for (const auto& value : thread_reduced_values) reducer(reduced_value, value);
+  return reduced_value;
+}
+
+template <class K, class V, class H, class L>
+void omp_robin_hood_hash_map<K, V, H, L>::apply(
+    const K& key, const std::function<void(const V&)>& handler) {
+  const auto& node_handler = [&](hash_slot* slot) {
+    if (slot) handler(slot->value);
+  };
+  hash_node_apply(key, node_handler);
+}
+
+template <class K, class V, class H, class L>
+void omp_robin_hood_hash_map<K, V, H, L>::apply(
+    const std::function<void(const K&, const V&)>& handler) {
+  const auto& node_handler = [&](hash_slot& slot) { handler(slot.key, slot.value); };
+  hash_node_apply(node_handler);
+}
+
+template <class K, class V, class H, class L>
+void omp_robin_hood_hash_map<K, V, H, L>::clear() {
+  first_touch_array<hash_slot> initial_slots(N_INITIAL_BUCKETS, policy);
+  segments.begin_global_operation();
+  slots = std::move(initial_slots);
+  n_buckets = N_INITIAL_BUCKETS;
+  segments.clear_n_keys();
+  is_near_max_load = false;
+  segments.end_global_operation();
+}
+
+template <class K, class V, class H, class L>
+void omp_robin_hood_hash_map<K, V, H, L>::hash_window_apply(
+    const K& key, const std::function<bool(const size_t, const size_t)>& window_handler) {
+  const size_t hash_value = hasher(key);
+  while (true) {
+    // The slots only change within a global operation.
+    const size_t version = segments.wait_for_global_operation();
+    const size_t home_id = hash_value % n_buckets;
+    size_t segment_id_1, segment_id_2;
+    const size_t window_length = get_window(home_id, segment_id_1, segment_id_2);
+    if (!segments.lock_pair(segment_id_1, segment_id_2, version)) continue;
+    const bool applied = window_handler(home_id, window_length);
+    segments.unlock_pair(segment_id_1, segment_id_2);
+    if (applied) return;
+    break;
+  }
+
+  // Slow path: the probe runs beyond the two segments.
+  segments.begin_global_operation();
+  try {
+    for (size_t n_growths = 0; !window_handler(hash_value % n_buckets, n_buckets); n_growths++) {
+      // No table size helps once the keys of the hash value fill the max probe length.
+      if (n_growths == MAX_N_GROWTHS || count_keys_of_hash(hash_value) >= MAX_PROBE_LENGTH ||
+          !grow_locked(omp_open_addressing::get_n_rehashing_buckets(n_buckets * 2))) {
+        throw std::length_error("too many keys with the same hash");
+      }
+    }
+  } catch (...) {
+    segments.end_global_operation();
+    throw;
+  }
+  segments.end_global_operation();
+}
+
+template <class K, class V, class H, class L>
+void omp_robin_hood_hash_map<K, V, H, L>::hash_node_apply(
+    const K& key, const std::function<void(hash_slot*)>& node_handler) {
+  const auto& window_handler = [&](const size_t home_id, const size_t window_length) {
+    size_t offset;
+    const probe_status status = find_slot(key, home_id, window_length, offset);
+    if (status == probe_status::out_of_window) return false;
+    node_handler(status == probe_status::found ? &slots[(home_id + offset) % n_buckets] : nullptr);
+    return true;
+  };
+  hash_window_apply(key, window_handler);
+}
+
+template <class K, class V, class H, class L>
+void omp_robin_hood_hash_map<K, V, H, L>::hash_node_apply(
+    const std::function<void(hash_slot&)>& node_handler) {
+  segments.begin_global_operation();
+#pragma omp parallel for schedule(static)
+  for (size_t i = 0; i < n_buckets; i++) {
+    if (slots[i].probe_length) node_handler(slots[i]);
+  }
+  segments.end_global_operation();
+}
+
+template <class K, class V, class H, class L>
+void omp_robin_hood_hash_map<K, V, H, L>::hash_node_insert_apply(
+    const K& key, const std::function<void(hash_slot&, const bool)>& node_handler) {
+  bool is_near_full = false;
+  const auto& window_handler = [&](const size_t home_id, const size_t window_length) {
+    size_t offset;
+    const probe_status status = find_slot(key, home_id, window_length, offset);
+    if (status == probe_status::out_of_window) return false;
+    const bool is_new = status == probe_status::not_found;
+    if (is_new) {
+      hash_slot slot;
+      slot.key = key;
+      if (!insert_slot(std::move(slot), home_id, window_length, offset)) return false;
+      is_near_full = count_new_key(home_id);
+    }
+    node_handler(slots[(home_id + offset) % n_buckets], is_new);
+    return true;
+  };
+  hash_window_apply(key, window_handler);
+  if (is_near_full && get_n_keys() >= n_buckets * max_load_factor) rehash_for_load();
+}
+
+template <class K, class V, class H, class L>
+typename omp_robin_hood_hash_map<K, V, H, L>::probe_status
+omp_robin_hood_hash_map<K, V, H, L>::find_slot(
+    const K& key, const size_t home_id, const size_t window_length, size_t& offset) {
+  for (offset = 0; offset < MAX_PROBE_LENGTH; offset++) {
+    if (offset >= window_length) return probe_status::out_of_window;
+    const hash_slot& slot = slots[(home_id + offset) % n_buckets];
+
+    // A key closer to its home slot than the probe means the key does not exist.
+    if (slot.probe_length < offset + 1) return probe_status::not_found;
+    if (slot.probe_length == offset + 1 && slot.key == key) return probe_status::found;
+  }
+  return probe_status::not_found;
+}
+
+template <class K, class V, class H, class L>
+bool omp_robin_hood_hash_map<K, V, H, L>::insert_slot(
+    hash_slot&& slot, const size_t home_id, const size_t window_length, const size_t offset) {
+  if (offset + 1 > MAX_PROBE_LENGTH) return false;
+
+  // Find the empty slot which ends the run to shift.
+  size_t end_offset = offset;
+  while (slots[(home_id + end_offset) % n_buckets].probe_length != 0) {
+    if (slots[(home_id + end_offset) % n_buckets].probe_length == MAX_PROBE_LENGTH) return false;
+    end_offset++;
+    if (end_offset >= window_length) return false;
+  }
+
+  for (size_t i = end_offset; i > offset; i--) {
+    hash_slot& target = slots[(home_id + i) % n_buckets];
+    target = std::move(slots[(home_id + i - 1) % n_buckets]);
+    target.probe_length++;
+  }
+  hash_slot& target = slots[(home_id + offset) % n_buckets];
+  target = std::move(slot);
+  target.probe_length = offset + 1;
+  return true;
+}
+
+template <class K, class V, class H, class L>
+bool omp_robin_hood_hash_map<K, V, H, L>::erase_slot(
+    const size_t home_id, const size_t window_length, const size_t offset) {
+  // Find the first following slot which is empty or holds a key at its home slot.
+  size_t end_offset = offset + 1;
+  while (true) {
+    if (end_offset >= window_length) return false;
+    if (slots[(home_id + end_offset) % n_buckets].probe_length <= 1) break;
+    end_offset++;
+  }
+
+  for (size_t i = offset; i + 1 < end_offset; i++) {
+    hash_slot& target = slots[(home_id + i) % n_buckets];
+    target = std::move(slots[(home_id + i + 1) % n_buckets]);
+    target.probe_length--;
+  }
+  slots[(home_id + end_offset - 1) % n_buckets] = hash_slot();
+  return true;
+}
+
+template <class K, class V, class H, class L>
+size_t omp_robin_hood_hash_map<K, V, H, L>::count_keys_of_hash(const size_t hash_value) {
+  // The keys of a home slot form a run from it, which ends at the first slot holding a key closer
+  // to its own home slot.
+  const size_t home_id = hash_value % n_buckets;
+  size_t n_keys = 0;
+  for (size_t offset = 0; offset < MAX_PROBE_LENGTH && offset < n_buckets; offset++) {
+    const hash_slot& slot = slots[(home_id + offset) % n_buckets];
+    if (slot.probe_length < offset + 1) break;
+    if (slot.probe_length == offset + 1 && hasher(slot.key) == hash_value) n_keys++;
+  }
+  return n_keys;
+}
+
+#endif
@@ -0,0 +1,243 @@
+#include "omp_robin_hood_hash_map.h"
+#include "gtest/gtest.h"
+#include "omp.h"
+#include "reducer.h"
+
+namespace {
+
+// Every ten keys share a hash value, so the probes form long runs across the segments.
+struct coarse_hasher {
+  size_t operator()(const int key) const { return (key / 10) * 2654435761ULL; }
+};
+
+// Maps every key to the same value, which no table size can hold more than 255 keys of.
+struct constant_hasher {
+  size_t operator()(const int) const { return 0; }
+};
+
+// Maps the negative keys to last_slot and the others to themselves, so that a test can make probes
+// run from the last slot of the table into the first ones.
+struct wrapping_hasher {
+  static size_t last_slot;
+  size_t operator()(const int key) const { return key < 0 ? last_slot : key; }
+};
+
+size_t wrapping_hasher::last_slot = 0;
+
+// Hashes as omp_hash while is_constant is false, and as constant_hasher otherwise, so that a test
+// can make the keys of a map collide in any larger table.
+struct switchable_hasher {
+  static bool is_constant;
+  size_t operator()(const int key) const { return is_constant ? 0 : omp_hash<int>()(key); }
+};
+
+bool switchable_hasher::is_constant = false;
+
+}  // namespace
+
+TEST(OMPRobinHoodHashMapTest, Initialization) {
+  omp_robin_hood_hash_map<std::string, int> m;
+  EXPECT_EQ(m.get_n_keys(), 0);
+  EXPECT_EQ(m.get_max_load_factor(), 0.9);
+}
+
+TEST(OMPRobinHoodHashMapTest, Reserve) {
+  omp_robin_hood_hash_map<std::string, int> m;
+  m.reserve(10);
+  EXPECT_GE(m.get_n_buckets(), 10);
+
+  // Automatic reserve tests.
+  omp_robin_hood_hash_map<int, int> m2;
+  for (int i = 0; i < 1000; i++) {
+    m2.set(i, i * i);
+    EXPECT_EQ(m2.get_n_keys(), i + 1);
+    EXPECT_LT(m2.get_load_factor(), m2.get_max_load_factor());
+  }
+  for (int i = 0; i < 1000; i++) {
+    EXPECT_EQ(m2.get_copy_or_default(i, 0), i * i);
+  }
+}
+
+TEST(OMPRobinHoodHashMapTest, SetAndUnset) {
+  omp_robin_hood_hash_map<std::string, int> m;
+  m.set("aa", 0);
+  m.set("aa", 1);
+  EXPECT_EQ(m.get_copy_or_default("aa", 0), 1);
+  const auto& increase_by_one = [&](auto& value) { value++; };
+  m.set("aa", increase_by_one);
+  EXPECT_EQ(m.get_copy_or_default("aa", 0), 2);
+  m.set("bbb", increase_by_one, 5);
+  EXPECT_EQ(m.get_copy_or_default("bbb", 0), 6);
+  EXPECT_EQ(m.get_n_keys(), 2);
+
+  m.unset("aa");
+  m.unset("not_exist_key");
+  EXPECT_FALSE(m.has("aa"));
+  EXPECT_TRUE(m.has("bbb"));
+  EXPECT_EQ(m.get_n_keys(), 1);
+}
+
+TEST(OMPRobinHoodHashMapTest, BackwardShiftDeletion) {
+  omp_robin_hood_hash_map<int, int, coarse_hasher> m;
+  for (int i = 0; i < 1000; i++) m.set(i, i);
+  EXPECT_EQ(m.get_n_keys(), 1000);
+  for (int i = 0; i < 1000; i += 3) m.unset(i);
+  for (int i = 0; i < 1000; i++) {
+    EXPECT_EQ(m.get_copy_or_default(i, -1), i % 3 != 0 ? i : -1);
+  }
+  for (int i = 0; i < 1000; i++) m.unset(i);
+  EXPECT_EQ(m.get_n_keys(), 0);
+  EXPECT_FALSE(m.has(1));
+}
+
+TEST(OMPRobinHoodHashMapTest, WrapAround) {
+  omp_robin_hood_hash_map<int, int, wrapping_hasher> m;
+  m.reserve(1000);
+  const size_t n_buckets = m.get_n_buckets();
+  wrapping_hasher::last_slot = n_buckets - 1;
+
+  // The keys homed in the last slot run into the first slots, and push the keys homed there on.
+  for (int i = 1; i <= 10; i++) m.set(-i, -i);
+  for (int i = 0; i < 5; i++) m.set(i, i);
+  EXPECT_EQ(m.get_n_buckets(), n_buckets);
+  EXPECT_EQ(m.get_n_keys(), 15);
+
+  // The removals shift the following keys backward across the end of the table.
+  m.unset(-1);
+  m.unset(2);
+  EXPECT_EQ(m.get_n_keys(), 13);
+  for (int i = 2; i <= 10; i++) EXPECT_EQ(m.get_copy_or_default(-i, 0), -i);
+  for (int i = 0; i < 5; i++) EXPECT_EQ(m.get_copy_or_default(i, -1), i != 2 ? i : -1);
+  EXPECT_FALSE(m.has(-1));
+  m.set(-1, -1);
+  m.set(2, 2);
+  EXPECT_EQ(m.get_copy_or_default(-1, 0), -1);
+  EXPECT_EQ(m.get_copy_or_default(2, -1), 2);
+  EXPECT_EQ(m.get_n_keys(), 15);
+}
+
+TEST(OMPRobinHoodHashMapTest, ProbeLengthLimit) {
+  // The probe length is bounded, so a hash value can be shared by limited number of keys, and the
+  // next one throws without growing the table.
+  omp_robin_hood_hash_map<int, int, constant_hasher> m;
+  for (int i = 0; i < 255; i++) m.set(i, i);
+  EXPECT_EQ(m.get_copy_or_default(254, 0), 254);
+  const size_t n_buckets = m.get_n_buckets();
+  EXPECT_THROW(m.set(255, 255), std::length_error);
+  EXPECT_EQ(m.get_n_buckets(), n_buckets);
+  EXPECT_EQ(m.get_n_keys(), 255);
+  EXPECT_FALSE(m.has(255));
+  for (int i = 0; i < 255; i++) EXPECT_EQ(m.get_copy_or_default(i, -1), i);
+
+  // The locks are released, so the map takes further updates.
+  m.unset(0);
+  m.set(255, 255);
+  EXPECT_EQ(m.get_copy_or_default(255, -1), 255);
+  EXPECT_EQ(m.get_n_keys(), 255);
+}
+
+TEST(OMPRobinHoodHashMapTest, FailedRehashKeepsMap) {
+  omp_robin_hood_hash_map<int, int, switchable_hasher> m;
+  for (int i = 0; i < 300; i++) m.set(i, i);
+  const size_t n_buckets = m.get_n_buckets();
+
+  // No larger table holds 300 keys of one hash value, so the rehash restores the old slots.
+  switchable_hasher::is_constant = true;
+  EXPECT_THROW(m.reserve(n_buckets * 4), std::length_error);
+  switchable_hasher::is_constant = false;
+  EXPECT_EQ(m.get_n_buckets(), n_buckets);
+  EXPECT_EQ(m.get_n_keys(), 300);
+  for (int i = 0; i < 300; i++) EXPECT_EQ(m.get_copy_or_default(i, -1), i);
+  m.reserve(n_buckets * 4);
+  EXPECT_GE(m.get_n_buckets(), n_buckets * 4);
+  for (int i = 0; i < 300; i++) EXPECT_EQ(m.get_copy_or_default(i, -1), i);
+}
+
+TEST(OMPRobinHoodHashMapTest, MapReduceAndApply) {
+  omp_robin_hood_hash_map<int, int> m;
+#pragma omp parallel for
+  for (int i = 0; i < 1000; i++) m.set(i, i);
+  EXPECT_EQ(m.get_n_keys(), 1000);
+  EXPECT_EQ(m.map<int>(5, [](const int value) { return value * 2; }, 0), 10);
+  const auto& get_value = [](const int key, const int value) {
+    (void)key;
+    return value;
+  };
+  EXPECT_EQ(m.map_reduce<int>(get_value, reducer::sum<int>, 0), 499500);
+  int sum = 0;
+  m.apply(5, [&](const int value) { sum += value; });
+  m.apply([&](const int key, const int value) {
+    (void)key;
+#pragma omp atomic
+    sum += value;
+  });
+  EXPECT_EQ(sum, 499505);
+
+  m.clear();
+  EXPECT_EQ(m.get_n_keys(), 0);
+  EXPECT_FALSE(m.has(5));
+}
+
+TEST(OMPRobinHoodHashMapTest, MoreThreadsThanAtConstruction) {
+  // The buffers of each thread follow the number of threads at the time of use.
+  omp_robin_hood_hash_map<int, int> m;
+  const int n_threads = omp_get_max_threads();
+  omp_set_num_threads(n_threads * 4);
+#pragma omp parallel for
+  for (int i = 0; i < 100000; i++) m.set(i, i);
+  EXPECT_EQ(m.get_n_keys(), 100000);
+  const auto& mapper = [](const int, const int value) { return value; };
+  EXPECT_EQ(m.map_reduce<long long>(mapper, reducer::sum<long long>, 0), 4999950000LL);
+  omp_set_num_threads(n_threads);
+}
+
+namespace {
+
+// Concurrent inserts, updates and removals of colliding keys, with more threads than at the
+// construction, so that the long probes and the rehashes run as global operations among them.
+template <class L>
+void update_concurrently() {
+  omp_robin_hood_hash_map<int, int, coarse_hasher, L> m;
+  const int n_threads = omp_get_max_threads();
+  omp_set_num_threads(n_threads * 4);
+#pragma omp parallel for
+  for (int i = 0; i < 100000; i++) {
+    m.set(i, i);
+    m.set(i, [](int& value) { value++; });
+    if (i % 2 == 0) m.unset(i);
+  }
+  omp_set_num_threads(n_threads);
+  EXPECT_EQ(m.get_n_keys(), 50000);
+  EXPECT_LE(m.get_load_factor(), m.get_max_load_factor());
+  const auto& mapper = [](const int, const int value) { return value; };
+  EXPECT_EQ(m.template map_reduce<long long>(mapper, reducer::sum<long long>, 0), 2500050000LL);
+}
+
+}  // namespace
+
+TEST(OMPRobinHoodHashMapTest, ConcurrentUpdates) { update_concurrently<omp_lock>(); }
+
+TEST(OMPRobinHoodHashMapTest, ConcurrentUpdatesWithSpinLock) { update_concurrently<spin_lock>(); }
+
+TEST(OMPRobinHoodHashMapTest, ConcurrentUpdatesWithFutexLock) {
+  update_concurrently<futex_lock>();
+}
+
+TEST(OMPRobinHoodHashMapLargeTest, TenMillionsGet) {
+  omp_robin_hood_hash_map<int, int> m;
+  constexpr int LARGE_N_KEYS = 10000000;
+
+  omp_set_nested(1);  // Parallel rehashing.
+#pragma omp parallel for
+  for (int i = 0; i < LARGE_N_KEYS; i++) {
+    m.set(i, i);
+  }
+  EXPECT_EQ(m.get_n_keys(), LARGE_N_KEYS);
+  long long sum = 0;
+#pragma omp parallel for reduction(+ : sum)
+  for (int i = 0; i < LARGE_N_KEYS; i++) {
+    sum += m.get_copy_or_default((i * 7919LL) % LARGE_N_KEYS, 0) +
+           m.get_copy_or_default(-i - 1, 0);
+  }
+  EXPECT_EQ(sum, (LARGE_N_KEYS - 1LL) * LARGE_N_KEYS / 2);
+}
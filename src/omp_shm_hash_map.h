@@ -0,0 +1,578 @@
+#ifndef OMP_SHM_HASH_MAP_H_
+#define OMP_SHM_HASH_MAP_H_
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "omp.h"
+#include "omp_hash.h"
+
+// A concurrent hash map living in a POSIX shared memory segment.
+// One process creates the map, then other processes on the same node attach to it by name, and
+// all of them can read and update it concurrently.
+// Nodes are linked by offsets into a node pool instead of pointers, and the segment locks are
+// process-shared mutexes instead of omp_lock_t. The capacity is fixed at creation.
+// The mutexes are robust, so a process dying with a segment locked does not block the others.
+// The next process to lock such a segment recounts its keys. Nodes are linked and unlinked by a
+// single store, so the buckets stay walkable, but the node the dead process was allocating or
+// freeing is lost to the pool, and a value it was writing may be left partly written.
+// K and V must be trivially copyable.
+template <class K, class V, class H = omp_hash<K>>
+class omp_shm_hash_map {
+  static_assert(std::is_trivially_copyable<K>::value, "K must be trivially copyable");
+  static_assert(std::is_trivially_copyable<V>::value, "V must be trivially copyable");
+
+ public:
+  // Create the shared memory segment of the specified name, which holds at most max_n_keys keys.
+  omp_shm_hash_map(const std::string& name, const size_t n_buckets, const size_t max_n_keys);
+
+  // Attach to the existing shared memory segment of the specified name.
+  // Wait up to ATTACH_TIMEOUT_MS for a process creating it concurrently to finish.
+  explicit omp_shm_hash_map(const std::string& name);
+
+  omp_shm_hash_map(const omp_shm_hash_map&) = delete;
+
+  omp_shm_hash_map& operator=(const omp_shm_hash_map&) = delete;
+
+  // Detach from the shared memory segment. The segment persists until unlink() is called.
+  ~omp_shm_hash_map();
+
+  // Remove the shared memory segment of the specified name.
+  static void unlink(const std::string& name) { shm_unlink(name.c_str()); }
+
+  // Return the number of buckets.
+  size_t get_n_buckets() const { return header->n_buckets; }
+
+  // Return the max number of keys the segment can hold.
+  size_t get_max_n_keys() const { return header->max_n_keys; }
+
+  // Return the number of keys.
+  size_t get_n_keys() const;
+
+  // Set the specified key to the specified value.
+  void set(const K& key, const V& value);
+
+  // Update the value of the specified key.
+  // If the key does not exist, construct it with the default initializer first.
+  void set(const K& key, const std::function<void(V&)>& setter);
+
+  // Update the value of the specified key.
+  // If the key does not exist, construct and set it to the default value passed in first.
+  void set(const K& key, const std::function<void(V&)>& setter, const V& default_value);
+
+  // Remove the specified key.
+  void unset(const K& key);
+
+  // Test if the specified key exists.
+  bool has(const K& key);
+
+  // Return a copy of the value of the specified key, or the default value if key does not exist.
+  V get_copy_or_default(const K& key, const V& default_value);
+
+  // Return the mapped value for the value of the specified key.
+  // If the key does not exist, return the default value.
+  template <class W>
+  W map(const K& key, const std::function<W(const V&)>& mapper, const W& default_value);
+
+  // Return the reduced value of the mapped values of all the keys.
+  // If no key exists, return the default value.
+  template <class W>
+  W map_reduce(
+      const std::function<W(const K&, const V&)>& mapper,
+      const std::function<void(W&, const W&)>& reducer,
+      const W& default_value);
+
+  // Apply the handler to the value of the specific key, if it exists.
+  void apply(const K& key, const std::function<void(const V&)>& handler);
+
+  // Apply the handler to all the keys.
+  void apply(const std::function<void(const K&, const V&)>& handler);
+
+  // Clear all keys.
+  void clear();
+
+ private:
+  constexpr static uint64_t MAGIC = 0x70616d6873616873;  // "shashmap".
+
+  constexpr static size_t N_SEGMENTS_PER_THREAD = 7;
+
+  constexpr static int ATTACH_TIMEOUT_MS = 1000;
+
+  // Offset of a node in the node pool plus one. Zero stands for no node.
+  typedef uint64_t node_ref;
+
+  struct shm_header {
+    uint64_t magic;
+    uint64_t n_buckets;
+    uint64_t max_n_keys;
+    uint64_t n_segments;
+    uint64_t node_size;
+    uint64_t n_used_nodes;
+  };
+
+  // Each segment keeps a free list of the nodes removed from its buckets and counts their keys.
+  struct shm_segment {
+    pthread_mutex_t lock;
+    node_ref free_nodes;
+    uint64_t n_keys;
+  };
+
+  struct shm_node {
+    K key;
+    V value;
+    node_ref next;
+  };
+
+  size_t n_mapped_bytes;
+
+  void* mapped;
+
+  shm_header* header;
+
+  shm_segment* segments;
+
+  node_ref* buckets;
+
+  shm_node* nodes;
+
+  H hasher;
+
+  // Offsets of the sections laid out after the header, each aligned for its type.
+  struct shm_layout {
+    size_t segments_offset;
+    size_t buckets_offset;
+    size_t nodes_offset;
+    size_t n_bytes;
+  };
+
+  static size_t align_offset(const size_t offset, const size_t alignment) {
+    return (offset + alignment - 1) / alignment * alignment;
+  }
+
+  static shm_layout get_layout(
+      const size_t n_buckets, const size_t max_n_keys, const size_t n_segments);
+
+  // Map n_mapped_bytes of the shared memory object and close its descriptor.
+  void map_segment(const int fd);
+
+  // Set the pointers to the sections laid out after the header.
+  void locate_sections(const shm_layout& layout);
+
+  // Lock the segment. If its previous owner died, take the lock over and recount the segment.
+  void lock_segment(shm_segment& segment);
+
+  // Handle the result of locking the segment. Return whether the segment is locked.
+  bool handle_lock_result(shm_segment& segment, const int result);
+
+  // Count the keys of the segment again and mark its lock consistent.
+  void recover_segment(shm_segment& segment);
+
+  shm_node& get_node(const node_ref ref) { return nodes[ref - 1]; }
+
+  // Take a node from the free list of the segment, the unused part of the node pool, or the free
+  // list of another segment, in that order. Must be called with the segment locked.
+  node_ref allocate_node(shm_segment& segment);
+
+  // Must be called with the segment locked.
+  void free_node(shm_segment& segment, const node_ref ref);
+
+  // Apply node_handler to the reference of the node which has the specific key.
+  // If the key does not exist, apply to the null reference at the end of the bucket.
+  void hash_node_apply(
+      const K& key, const std::function<void(shm_segment&, node_ref&)>& node_handler);
+
+  // Apply node_handler to all the hash nodes.
+  void hash_node_apply(const std::function<void(shm_node&)>& node_handler);
+
+  void lock_all_segments();
+
+  void unlock_all_segments();
+};
+
+template <class K, class V, class H>
+omp_shm_hash_map<K, V, H>::omp_shm_hash_map(
+    const std::string& name, const size_t n_buckets, const size_t max_n_keys) {
+  if (n_buckets == 0) throw std::invalid_argument("n_buckets must be positive");
+  const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0) throw std::runtime_error("cannot create shared memory " + name);
+  const size_t n_segments = omp_get_max_threads() * N_SEGMENTS_PER_THREAD;
+  const shm_layout& layout = get_layout(n_buckets, max_n_keys, n_segments);
+  n_mapped_bytes = layout.n_bytes;
+  if (ftruncate(fd, n_mapped_bytes) != 0) {
+    close(fd);
+    shm_unlink(name.c_str());
+    throw std::runtime_error("cannot allocate shared memory " + name);
+  }
+
+  // Attaching processes wait for the magic, so a half created object shall not stay behind.
+  try {
+    map_segment(fd);
+  } catch (...) {
+    shm_unlink(name.c_str());
+    throw;
+  }
+  locate_sections(layout);
+
+  // The pages of a new shared memory object are zero filled, so all the buckets are empty.
+  header->n_buckets = n_buckets;
+  header->max_n_keys = max_n_keys;
+  header->n_segments = n_segments;
+  header->node_size = sizeof(shm_node);
+  pthread_mutexattr_t lock_attr;
+  bool initialized = pthread_mutexattr_init(&lock_attr) == 0;
+  initialized = initialized &&
+                pthread_mutexattr_setpshared(&lock_attr, PTHREAD_PROCESS_SHARED) == 0 &&
+                pthread_mutexattr_setrobust(&lock_attr, PTHREAD_MUTEX_ROBUST) == 0;
+  for (size_t i = 0; initialized && i < n_segments; i++) {
+    initialized = pthread_mutex_init(&segments[i].lock, &lock_attr) == 0;
+  }
+  pthread_mutexattr_destroy(&lock_attr);
+  if (!initialized) {
+    munmap(mapped, n_mapped_bytes);
+    shm_unlink(name.c_str());
+    throw std::runtime_error("cannot initialize shared memory " + name);
+  }
+
+  // Publish the map to the attaching processes.
+  __sync_synchronize();
+  header->magic = MAGIC;
+}
+
+template <class K, class V, class H>
+omp_shm_hash_map<K, V, H>::omp_shm_hash_map(const std::string& name) {
+  const int fd = shm_open(name.c_str(), O_RDWR, 0600);
+  if (fd < 0) throw std::runtime_error("cannot open shared memory " + name);
+
+  // The creator sizes the object right after creating it and sets the magic last.
+  struct stat shm_stat;
+  int n_waited_ms = 0;
+  while (fstat(fd, &shm_stat) == 0 && shm_stat.st_size == 0 && n_waited_ms < ATTACH_TIMEOUT_MS) {
+    usleep(1000);
+    n_waited_ms++;
+  }
+  if (fstat(fd, &shm_stat) != 0 || static_cast<size_t>(shm_stat.st_size) < sizeof(shm_header)) {
+    close(fd);
+    throw std::runtime_error("invalid shared memory " + name);
+  }
+  n_mapped_bytes = shm_stat.st_size;
+  map_segment(fd);
+  const shm_header* created_header = static_cast<const shm_header*>(mapped);
+  while (__atomic_load_n(&created_header->magic, __ATOMIC_ACQUIRE) == 0 &&
+         n_waited_ms < ATTACH_TIMEOUT_MS) {
+    usleep(1000);
+    n_waited_ms++;
+  }
+  if (__atomic_load_n(&created_header->magic, __ATOMIC_ACQUIRE) != MAGIC ||
+      created_header->node_size != sizeof(shm_node)) {
+    munmap(mapped, n_mapped_bytes);
+    throw std::runtime_error("invalid shared memory " + name);
+  }
+  const shm_layout& layout = get_layout(
+      created_header->n_buckets, created_header->max_n_keys, created_header->n_segments);
+  if (n_mapped_bytes != layout.n_bytes) {
+    munmap(mapped, n_mapped_bytes);
+    throw std::runtime_error("invalid shared memory " + name);
+  }
+  locate_sections(layout);
+}
+
+template <class K, class V, class H>
+omp_shm_hash_map<K, V, H>::~omp_shm_hash_map() {
+  munmap(mapped, n_mapped_bytes);
+}
+
+template <class K, class V, class H>
+void omp_shm_hash_map<K, V, H>::map_segment(const int fd) {
+  mapped = mmap(nullptr, n_mapped_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) throw std::runtime_error("cannot mmap shared memory");
+}
+
+template <class K, class V, class H>
+typename omp_shm_hash_map<K, V, H>::shm_layout omp_shm_hash_map<K, V, H>::get_layout(
+    const size_t n_buckets, const size_t max_n_keys, const size_t n_segments) {
+  shm_layout layout;
+  layout.segments_offset = align_offset(sizeof(shm_header), alignof(shm_segment));
+  layout.buckets_offset =
+      align_offset(layout.segments_offset + n_segments * sizeof(shm_segment), alignof(node_ref));
+  layout.nodes_offset =
+      align_offset(layout.buckets_offset + n_buckets * sizeof(node_ref), alignof(shm_node));
+  layout.n_bytes = layout.nodes_offset + max_n_keys * sizeof(shm_node);
+  return layout;
+}
+
+template <class K, class V, class H>
+void omp_shm_hash_map<K, V, H>::locate_sections(const shm_layout& layout) {
+  char* section = static_cast<char*>(mapped);
+  header = reinterpret_cast<shm_header*>(section);
+  segments = reinterpret_cast<shm_segment*>(section + layout.segments_offset);
+  buckets = reinterpret_cast<node_ref*>(section + layout.buckets_offset);
+  nodes = reinterpret_cast<shm_node*>(section + layout.nodes_offset);
+}
+
+template <class K, class V, class H>
+size_t omp_shm_hash_map<K, V, H>::get_n_keys() const {
+  size_t n_keys = 0;
+  for (size_t i = 0; i < header->n_segments; i++) {
+    n_keys += __atomic_load_n(&segments[i].n_keys, __ATOMIC_RELAXED);
+  }
+  return n_keys;
+}
+
+template <class K, class V, class H>
+void omp_shm_hash_map<K, V, H>::lock_segment(shm_segment& segment) {
+  if (!handle_lock_result(segment, pthread_mutex_lock(&segment.lock))) {
+    throw std::runtime_error("cannot lock shared memory segment");
+  }
+}
+
+template <class K, class V, class H>
+bool omp_shm_hash_map<K, V, H>::handle_lock_result(shm_segment& segment, const int result) {
+  if (result == 0) return true;
+  if (result != EOWNERDEAD) return false;
+  recover_segment(segment);
+  return true;
+}
+
+template <class K, class V, class H>
+void omp_shm_hash_map<K, V, H>::recover_segment(shm_segment& segment) {
+  // The dead owner may have linked or unlinked a node without counting it.
+  const size_t n_segments = header->n_segments;
+  const size_t n_buckets = header->n_buckets;
+  uint64_t n_keys = 0;
+  for (size_t i = &segment - segments; i < n_buckets; i += n_segments) {
+    for (node_ref ref = buckets[i]; ref; ref = get_node(ref).next) n_keys++;
+  }
+  __atomic_store_n(&segment.n_keys, n_keys, __ATOMIC_RELAXED);
+  if (pthread_mutex_consistent(&segment.lock) != 0) {
+    pthread_mutex_unlock(&segment.lock);
+    throw std::runtime_error("cannot recover shared memory segment");
+  }
+}
+
+template <class K, class V, class H>
+typename omp_shm_hash_map<K, V, H>::node_ref omp_shm_hash_map<K, V, H>::allocate_node(
+    shm_segment& segment) {
+  if (segment.free_nodes) {
+    const node_ref ref = segment.free_nodes;
+    segment.free_nodes = get_node(ref).next;
+    return ref;
+  }
+  const uint64_t node_id = __sync_fetch_and_add(&header->n_used_nodes, 1);
+  if (node_id < header->max_n_keys) return node_id + 1;
+  __sync_fetch_and_sub(&header->n_used_nodes, 1);
+
+  // Take a free node from another segment. Only try locking to avoid deadlocks.
+  for (size_t i = 0; i < header->n_segments; i++) {
+    shm_segment& other_segment = segments[i];
+    if (&other_segment == &segment) continue;
+    if (!handle_lock_result(other_segment, pthread_mutex_trylock(&other_segment.lock))) continue;
+    const node_ref ref = other_segment.free_nodes;
+    if (ref) other_segment.free_nodes = get_node(ref).next;
+    pthread_mutex_unlock(&other_segment.lock);
+    if (ref) return ref;
+  }
+  throw std::length_error("shared memory hash map is full");
+}
+
+template <class K, class V, class H>
+void omp_shm_hash_map<K, V, H>::free_node(shm_segment& segment, const node_ref ref) {
+  get_node(ref).next = segment.free_nodes;
+  segment.free_nodes = ref;
+}
+
+template <class K, class V, class H>
+void omp_shm_hash_map<K, V, H>::set(const K& key, const V& value) {
+  const auto& node_handler = [&](shm_segment& segment, node_ref& ref) {
+    if (!ref) {
+      const node_ref new_ref = allocate_node(segment);
+      get_node(new_ref) = {key, value, 0};
+      ref = new_ref;
+      __atomic_fetch_add(&segment.n_keys, 1, __ATOMIC_RELAXED);
+    } else {
+      get_node(ref).value = value;
+    }
+  };
+  hash_node_apply(key, node_handler);
+}
+
+template <class K, class V, class H>
+void omp_shm_hash_map<K, V, H>::set(const K& key, const std::function<void(V&)>& setter) {
+  const auto& node_handler = [&](shm_segment& segment, node_ref& ref) {
+    if (!ref) {
+      const node_ref new_ref = allocate_node(segment);
+      get_node(new_ref) = {key, V(), 0};
+      ref = new_ref;
+      __atomic_fetch_add(&segment.n_keys, 1, __ATOMIC_RELAXED);
+    }
+    setter(get_node(ref).value);
+  };
+  hash_node_apply(key, node_handler);
+}
+
+template <class K, class V, class H>
+void omp_shm_hash_map<K, V, H>::set(
+    const K& key, const std::function<void(V&)>& setter, const V& default_value) {
+  const auto& node_handler = [&](shm_segment& segment, node_ref& ref) {
+    if (!ref) {
+      const node_ref new_ref = allocate_node(segment);
+      get_node(new_ref) = {key, default_value, 0};
+      ref = new_ref;
+      __atomic_fetch_add(&segment.n_keys, 1, __ATOMIC_RELAXED);
+    }
+    setter(get_node(ref).value);
+  };
+  hash_node_apply(key, node_handler);
+}
+
+template <class K, class V, class H>
+void omp_shm_hash_map<K, V, H>::unset(const K& key) {
+  const auto& node_handler = [&](shm_segment& segment, node_ref& ref) {
+    if (ref) {
+      const node_ref removed_ref = ref;
+      ref = get_node(ref).next;
+      free_node(segment, removed_ref);
+      __atomic_fetch_sub(&segment.n_keys, 1, __ATOMIC_RELAXED);
+    }
+  };
+  hash_node_apply(key, node_handler);
+}
+
+template <class K, class V, class H>
+bool omp_shm_hash_map<K, V, H>::has(const K& key) {
+  bool has_key = false;
+  const auto& node_handler = [&](shm_segment&, node_ref& ref) {
+    if (ref) has_key = true;
+  };
+  hash_node_apply(key, node_handler);
+  return has_key;
+}
+
+template <class K, class V, class H>
+V omp_shm_hash_map<K, V, H>::get_copy_or_default(const K& key, const V& default_value) {
+  V value(default_value);
+  const auto& node_handler = [&](shm_segment&, node_ref& ref) {
+    if (ref) value = get_node(ref).value;
+  };
+  hash_node_apply(key, node_handler);
+  return value;
+}
+
+template <class K, class V, class H>
+template <class W>
+W omp_shm_hash_map<K, V, H>::map(
+    const K& key, const std::function<W(const V&)>& mapper, const W& default_value) {
+  W mapped_value(default_value);
+  const auto& node_handler = [&](shm_segment&, node_ref& ref) {
+    if (ref) mapped_value = mapper(get_node(ref).value);
+  };
+  hash_node_apply(key, node_handler);
+  return mapped_value;
+}
+
+template <class K, class V, class H>
+template <class W>
+W omp_shm_hash_map<K, V, H>::map_reduce(
+    const std::function<W(const K&, const V&)>& mapper,
+    const std::function<void(W&, const W&)>& reducer,
+    const W& default_value) {
+  std::vector<W> thread_reduced_values(omp_get_max_threads(), default_value);
+  W reduced_value = default_value;
+  const auto& node_handler = [&](shm_node& node) {
+    const size_t thread_id = omp_get_thread_num();
+    const W& mapped_value = mapper(node.key, node.value);
+    reducer(thread_reduced_values[thread_id], mapped_value);
+  };
+  hash_node_apply(node_handler);
+  for (const auto& value : thread_reduced_values) reducer(reduced_value, value);
+  return reduced_value;
+}
+
+template <class K, class V, class H>
+void omp_shm_hash_map<K, V, H>::apply(const K& key, const std::function<void(const V&)>& handler) {
+  const auto& node_handler = [&](shm_segment&, node_ref& ref) {
+    if (ref) handler(get_node(ref).value);
+  };
+  hash_node_apply(key, node_handler);
+}
+
+template <class K, class V, class H>
+void omp_shm_hash_map<K, V, H>::apply(const std::function<void(const K&, const V&)>& handler) {
+  const auto& node_handler = [&](shm_node& node) { handler(node.key, node.value); };
+  hash_node_apply(node_handler);
+}
+
+template <class K, class V, class H>
+void omp_shm_hash_map<K, V, H>::clear() {
+  lock_all_segments();
+
+  // The node pool is reset last, so a process dying meanwhile leaves no node both linked and free.
+  const size_t n_buckets = header->n_buckets;
+#pragma omp parallel for schedule(static)
+  for (size_t i = 0; i < n_buckets; i++) {
+    buckets[i] = 0;
+  }
+  for (size_t i = 0; i < header->n_segments; i++) {
+    segments[i].free_nodes = 0;
+    __atomic_store_n(&segments[i].n_keys, 0, __ATOMIC_RELAXED);
+  }
+  __atomic_store_n(&header->n_used_nodes, 0, __ATOMIC_RELEASE);
+  unlock_all_segments();
+}
+
+template <class K, class V, class H>
+void omp_shm_hash_map<K, V, H>::hash_node_apply(
+    const K& key, const std::function<void(shm_segment&, node_ref&)>& node_handler) {
+  const size_t bucket_id = hasher(key) % header->n_buckets;
+  shm_segment& segment = segments[bucket_id % header->n_segments];
+  lock_segment(segment);
+  node_ref* ref = &buckets[bucket_id];
+  while (*ref && !(get_node(*ref).key == key)) ref = &get_node(*ref).next;
+  try {
+    node_handler(segment, *ref);
+  } catch (...) {
+    pthread_mutex_unlock(&segment.lock);
+    throw;
+  }
+  pthread_mutex_unlock(&segment.lock);
+}
+
+template <class K, class V, class H>
+void omp_shm_hash_map<K, V, H>::hash_node_apply(
+    const std::function<void(shm_node&)>& node_handler) {
+  lock_all_segments();
+  const size_t n_buckets = header->n_buckets;
+#pragma omp parallel for schedule(static)
+  for (size_t i = 0; i < n_buckets; i++) {
+    for (node_ref ref = buckets[i]; ref; ref = get_node(ref).next) node_handler(get_node(ref));
+  }
+  unlock_all_segments();
+}
+
+template <class K, class V, class H>
+void omp_shm_hash_map<K, V, H>::lock_all_segments() {
+  for (size_t i = 0; i < header->n_segments; i++) {
+    try {
+      lock_segment(segments[i]);
+    } catch (...) {
+      while (i > 0) pthread_mutex_unlock(&segments[--i].lock);
+      throw;
+    }
+  }
+}
+
+template <class K, class V, class H>
+void omp_shm_hash_map<K, V, H>::unlock_all_segments() {
+  for (size_t i = 0; i < header->n_segments; i++) pthread_mutex_unlock(&segments[i].lock);
+}
+
+#endif
@@ -0,0 +1,184 @@
+#include "omp_shm_hash_map.h"
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cstdint>
+#include "gtest/gtest.h"
+#include "omp.h"
+#include "reducer.h"
+
+TEST(OMPSHMHashMapTest, Initialization) {
+  omp_shm_hash_map<int, int>::unlink("/omp_shm_hash_map_test_init");
+  omp_shm_hash_map<int, int> m("/omp_shm_hash_map_test_init", 100, 1000);
+  EXPECT_EQ(m.get_n_keys(), 0);
+  EXPECT_EQ(m.get_n_buckets(), 100);
+  EXPECT_EQ(m.get_max_n_keys(), 1000);
+
+  // Creating an existing map shall fail.
+  EXPECT_THROW(
+      (omp_shm_hash_map<int, int>("/omp_shm_hash_map_test_init", 100, 1000)), std::runtime_error);
+  EXPECT_THROW((omp_shm_hash_map<int, int>("/omp_shm_hash_map_test_none")), std::runtime_error);
+  omp_shm_hash_map<int, int>::unlink("/omp_shm_hash_map_test_init");
+}
+
+TEST(OMPSHMHashMapTest, SetUnsetAndCapacity) {
+  omp_shm_hash_map<int, int>::unlink("/omp_shm_hash_map_test_set");
+  omp_shm_hash_map<int, int> m("/omp_shm_hash_map_test_set", 7, 10);
+  for (int i = 0; i < 10; i++) m.set(i, i * i);
+  EXPECT_EQ(m.get_n_keys(), 10);
+  EXPECT_THROW(m.set(10, 100), std::length_error);
+  EXPECT_EQ(m.get_n_keys(), 10);
+
+  // Removed nodes shall be reused.
+  m.unset(3);
+  EXPECT_FALSE(m.has(3));
+  m.set(10, 100);
+  EXPECT_EQ(m.get_copy_or_default(10, 0), 100);
+
+  const auto& increase_by_one = [&](auto& value) { value++; };
+  m.set(10, increase_by_one);
+  EXPECT_EQ(m.get_copy_or_default(10, 0), 101);
+  m.unset(10);
+  m.set(11, increase_by_one, 5);
+  EXPECT_EQ(m.get_copy_or_default(11, 0), 6);
+  EXPECT_EQ(m.map<int>(2, [](const int value) { return value * 2; }, 0), 8);
+
+  m.clear();
+  EXPECT_EQ(m.get_n_keys(), 0);
+  EXPECT_FALSE(m.has(0));
+  for (int i = 0; i < 10; i++) m.set(i, i);
+  EXPECT_EQ(m.get_n_keys(), 10);
+  omp_shm_hash_map<int, int>::unlink("/omp_shm_hash_map_test_set");
+}
+
+TEST(OMPSHMHashMapTest, SharedAcrossProcesses) {
+  omp_shm_hash_map<int, double>::unlink("/omp_shm_hash_map_test_fork");
+  omp_shm_hash_map<int, double> m("/omp_shm_hash_map_test_fork", 1000, 1000);
+  m.set(0, 0.5);
+
+  const pid_t pid = fork();
+  if (pid == 0) {
+    // Child process attaches by name and updates the map.
+    omp_shm_hash_map<int, double> child_m("/omp_shm_hash_map_test_fork");
+    for (int i = 1; i < 100; i++) child_m.set(i, i * 0.5);
+    child_m.set(0, [](double& value) { value += 1.0; });
+    _exit(0);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  EXPECT_EQ(status, 0);
+
+  EXPECT_EQ(m.get_n_keys(), 100);
+  EXPECT_EQ(m.get_copy_or_default(0, 0.0), 1.5);
+  for (int i = 1; i < 100; i++) EXPECT_EQ(m.get_copy_or_default(i, 0.0), i * 0.5);
+  omp_shm_hash_map<int, double>::unlink("/omp_shm_hash_map_test_fork");
+}
+
+TEST(OMPSHMHashMapTest, AttachWhileCreating) {
+  // Attaching races the creator, and shall wait for it rather than fail.
+  for (int i = 0; i < 500; i++) {
+    omp_shm_hash_map<int, int>::unlink("/omp_shm_hash_map_test_attach");
+    const pid_t pid = fork();
+    if (pid == 0) {
+      while (true) {
+        try {
+          omp_shm_hash_map<int, int> child_m("/omp_shm_hash_map_test_attach");
+          child_m.set(1, 1);
+          _exit(0);
+        } catch (const std::runtime_error& error) {
+          // Not created yet.
+          if (std::string(error.what()).find("cannot open") != 0) _exit(1);
+        }
+      }
+    }
+    omp_shm_hash_map<int, int> m("/omp_shm_hash_map_test_attach", 100000, 100000);
+    int status;
+    waitpid(pid, &status, 0);
+    EXPECT_EQ(status, 0);
+    EXPECT_EQ(m.get_copy_or_default(1, 0), 1);
+  }
+  omp_shm_hash_map<int, int>::unlink("/omp_shm_hash_map_test_attach");
+}
+
+TEST(OMPSHMHashMapTest, OwnerDied) {
+  omp_shm_hash_map<int, double>::unlink("/omp_shm_hash_map_test_died");
+  omp_shm_hash_map<int, double> m("/omp_shm_hash_map_test_died", 100, 100);
+  m.set(0, 0.5);
+
+  const pid_t pid = fork();
+  if (pid == 0) {
+    // Child process exits with the segment of key 0 locked.
+    omp_shm_hash_map<int, double> child_m("/omp_shm_hash_map_test_died");
+    child_m.set(0, [](double&) { _exit(0); });
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  EXPECT_EQ(status, 0);
+
+  m.set(0, [](double& value) { value += 1.0; });
+  EXPECT_EQ(m.get_copy_or_default(0, 0.0), 1.5);
+  m.set(1, 1.0);
+  EXPECT_EQ(m.get_n_keys(), 2);
+
+  // Child process exits with all the segments locked.
+  const pid_t apply_pid = fork();
+  if (apply_pid == 0) {
+    omp_shm_hash_map<int, double> child_m("/omp_shm_hash_map_test_died");
+    child_m.apply([](const int, const double) { _exit(0); });
+  }
+  waitpid(apply_pid, &status, 0);
+  EXPECT_EQ(status, 0);
+
+  for (int i = 0; i < 100; i++) m.set(i, i * 0.5);
+  EXPECT_EQ(m.get_n_keys(), 100);
+  m.clear();
+  EXPECT_EQ(m.get_n_keys(), 0);
+  omp_shm_hash_map<int, double>::unlink("/omp_shm_hash_map_test_died");
+}
+
+TEST(OMPSHMHashMapTest, FailedCreation) {
+  // The object is sized but cannot be mapped, and shall not be left for attachers to wait on.
+  omp_shm_hash_map<int, int>::unlink("/omp_shm_hash_map_test_failed");
+  EXPECT_THROW(
+      (omp_shm_hash_map<int, int>("/omp_shm_hash_map_test_failed", 100, size_t(1) << 56)),
+      std::runtime_error);
+  EXPECT_THROW((omp_shm_hash_map<int, int>("/omp_shm_hash_map_test_failed")), std::runtime_error);
+  omp_shm_hash_map<int, int> m("/omp_shm_hash_map_test_failed", 100, 100);
+  omp_shm_hash_map<int, int>::unlink("/omp_shm_hash_map_test_failed");
+}
+
+TEST(OMPSHMHashMapTest, AlignedSections) {
+  struct alignas(64) aligned_value {
+    double value;
+  };
+  omp_shm_hash_map<int, aligned_value>::unlink("/omp_shm_hash_map_test_aligned");
+  omp_shm_hash_map<int, aligned_value> m("/omp_shm_hash_map_test_aligned", 3, 10);
+  for (int i = 0; i < 10; i++) m.set(i, {i * 0.5});
+  for (int i = 0; i < 10; i++) {
+    m.apply(i, [&](const aligned_value& value) {
+      EXPECT_EQ(reinterpret_cast<uintptr_t>(&value) % alignof(aligned_value), 0);
+      EXPECT_EQ(value.value, i * 0.5);
+    });
+  }
+  omp_shm_hash_map<int, aligned_value>::unlink("/omp_shm_hash_map_test_aligned");
+}
+
+TEST(OMPSHMHashMapTest, MapReduce) {
+  omp_shm_hash_map<int, int>::unlink("/omp_shm_hash_map_test_reduce");
+  omp_shm_hash_map<int, int> m("/omp_shm_hash_map_test_reduce", 37, 1000);
+#pragma omp parallel for
+  for (int i = 0; i < 100; i++) m.set(i, i);
+  const auto& get_value = [](const int key, const int value) {
+    (void)key;
+    return value;
+  };
+  EXPECT_EQ(m.map_reduce<int>(get_value, reducer::sum<int>, 0), 4950);
+  int sum = 0;
+  m.apply(5, [&](const int value) { sum += value; });
+  m.apply([&](const int key, const int value) {
+    (void)key;
+#pragma omp atomic
+    sum += value;
+  });
+  EXPECT_EQ(sum, 4955);
+  omp_shm_hash_map<int, int>::unlink("/omp_shm_hash_map_test_reduce");
+}
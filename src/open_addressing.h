@@ -0,0 +1,254 @@
+#ifndef OPEN_ADDRESSING_H_
+#define OPEN_ADDRESSING_H_
+
+#include <sched.h>
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <utility>
+#include "first_touch.h"
+#include "lock.h"
+
+// The parts shared by the open addressing containers: omp_cuckoo_hash_map,
+// omp_robin_hood_hash_map and omp_hopscotch_hash_set.
+
+namespace omp_open_addressing {
+
+// Return a number of buckets larger than or equal to the specified number, which is either a prime
+// number itself, or a prime number times powers of 15858.
+inline size_t get_n_rehashing_buckets(const size_t n_buckets) {
+  constexpr size_t PRIME_NUMBERS[] = {11,   17,    29,    47,    79,    127,   211,
+                                      337,  547,   887,   1433,  2311,  3739,  6053,
+                                      9791, 15858, 25667, 41539, 67213, 104729};
+  constexpr size_t N_PRIME_NUMBERS = sizeof(PRIME_NUMBERS) / sizeof(size_t);
+  constexpr size_t LAST_PRIME_NUMBER = PRIME_NUMBERS[N_PRIME_NUMBERS - 1];
+  constexpr size_t DIVISION_FACTOR = 15858;
+  size_t remaining_factor = n_buckets;
+  size_t n_rehashing_buckets = 1;
+  for (size_t i = 0; i < 3; i++) {
+    if (remaining_factor > LAST_PRIME_NUMBER) {
+      remaining_factor /= DIVISION_FACTOR;
+      n_rehashing_buckets *= DIVISION_FACTOR;
+    }
+  }
+  if (remaining_factor > LAST_PRIME_NUMBER) throw std::invalid_argument("n_buckets too large");
+  size_t left = 0, right = N_PRIME_NUMBERS - 1;
+  while (left < right) {
+    size_t mid = (left + right) / 2;
+    if (PRIME_NUMBERS[mid] < remaining_factor) {
+      left = mid + 1;
+    } else {
+      right = mid;
+    }
+  }
+  n_rehashing_buckets *= PRIME_NUMBERS[left];
+  return n_rehashing_buckets;
+}
+
+// Return the number of slots of each segment of a table whose segments are contiguous ranges of
+// slots, at least min_segment_size long. The last used segment may be shorter.
+inline size_t get_segment_size(
+    const size_t n_buckets, const size_t n_segments, const size_t min_segment_size) {
+  return std::max(min_segment_size, (n_buckets + n_segments - 1) / n_segments);
+}
+
+// Return the number of slots from the home slot to the end of the next segment, which are covered
+// by the locks of the two segments, and set the two segment ids, the lower one first. The window
+// wraps around from the last used segment to the first one, and spans the whole table if there are
+// no more than two used segments.
+inline size_t get_window(
+    const size_t home_id,
+    const size_t n_buckets,
+    const size_t segment_size,
+    size_t& segment_id_1,
+    size_t& segment_id_2) {
+  const size_t n_used_segments = (n_buckets + segment_size - 1) / segment_size;
+  const size_t home_segment_id = home_id / segment_size;
+  const size_t next_segment_id = (home_segment_id + 1) % n_used_segments;
+  segment_id_1 = std::min(home_segment_id, next_segment_id);
+  segment_id_2 = std::max(home_segment_id, next_segment_id);
+  if (n_used_segments <= 2) return n_buckets;
+  if (next_segment_id > home_segment_id) {
+    return std::min((home_segment_id + 2) * segment_size, n_buckets) - home_id;
+  }
+  return n_buckets - home_id + segment_size;
+}
+
+// The segments of an open addressing table, each with a lock and the number of keys homed in it.
+// An operation locks the segments of the slots it may touch, at most two, and a global operation,
+// such as a rehash, a clear or a traversal, has the whole table, as in omp_hash_map: it announces
+// itself by making the global version odd, and waits for the operations in flight, which set an
+// in-use flag under their locks, instead of taking every lock. An operation which has read the
+// table before the announcement backs off once it holds its locks.
+// L is the lock policy, one of those in lock.h.
+template <class L>
+class segment_locks {
+ public:
+  explicit segment_locks(const size_t n_segments) : segments(n_segments), global_version(0) {}
+
+  segment_locks(const segment_locks&) = delete;
+
+  segment_locks& operator=(const segment_locks&) = delete;
+
+  size_t size() const { return segments.size(); }
+
+  // Wait until no global operation is running.
+  // Return the version of the global operations, which is even.
+  size_t wait_for_global_operation() const {
+    while (true) {
+      const size_t version = __atomic_load_n(&global_version, __ATOMIC_ACQUIRE);
+      if (!(version & 1)) return version;
+      sched_yield();
+    }
+  }
+
+  // Lock the two segments, in the order of their ids to avoid deadlocks, for an operation which has
+  // read the table at the specified version. Return false, with the segments unlocked, if a global
+  // operation has started since. The ids may be equal.
+  bool lock_pair(const size_t segment_id_1, const size_t segment_id_2, const size_t version);
+
+  void unlock_pair(const size_t segment_id_1, const size_t segment_id_2);
+
+  // Same as above with the rehashing locks, for the parallel loops of a rehash.
+  void lock_rehashing_pair(const size_t segment_id_1, const size_t segment_id_2);
+
+  void unlock_rehashing_pair(const size_t segment_id_1, const size_t segment_id_2);
+
+  // Start a global operation, which waits for the operations in the segments to finish and holds
+  // back new ones until it ends. Global operations are serialized.
+  void begin_global_operation();
+
+  void end_global_operation() {
+    __atomic_store_n(&global_version, global_version + 1, __ATOMIC_RELEASE);
+    global_lock.unlock();
+  }
+
+  // Return the number of keys summed over the segments.
+  size_t get_n_keys() const;
+
+  // Return the number of keys of the segment.
+  size_t get_n_keys(const size_t segment_id) const {
+    return __atomic_load_n(&segments[segment_id].n_keys, __ATOMIC_RELAXED);
+  }
+
+  // Add delta to the number of keys of the segment and return the new number. The segment shall be
+  // locked, or a global operation be running.
+  size_t add_n_keys(const size_t segment_id, const int delta) {
+    const size_t n_keys = segments[segment_id].n_keys + delta;
+    __atomic_store_n(&segments[segment_id].n_keys, n_keys, __ATOMIC_RELAXED);
+    return n_keys;
+  }
+
+  // The keys moved by a rehash are counted apart, under the rehashing locks, and replace the
+  // numbers of keys once the rehash has placed all of them, so that a failed rehash leaves the
+  // numbers of keys as they were. Within a global operation.
+  void reset_n_rehashed_keys() {
+    for (size_t i = 0; i < segments.size(); i++) segments[i].n_rehashed_keys = 0;
+  }
+
+  void add_n_rehashed_keys(const size_t segment_id) { segments[segment_id].n_rehashed_keys++; }
+
+  void commit_n_rehashed_keys() {
+    for (size_t i = 0; i < segments.size(); i++) {
+      __atomic_store_n(&segments[i].n_keys, segments[i].n_rehashed_keys, __ATOMIC_RELAXED);
+    }
+  }
+
+  // Set the numbers of keys to zero. Within a global operation.
+  void clear_n_keys() {
+    for (size_t i = 0; i < segments.size(); i++) {
+      __atomic_store_n(&segments[i].n_keys, 0, __ATOMIC_RELAXED);
+    }
+  }
+
+ private:
+  constexpr static size_t CACHE_LINE_SIZE = 64;
+
+  // The locks and the key counter of a segment fill a cache line of their own, so that threads
+  // working on adjacent segments never invalidate the lines of each other.
+  struct alignas(CACHE_LINE_SIZE) segment {
+    L lock;
+    // For parallel rehashing, by the threads of the rehash.
+    L rehashing_lock;
+    // The number of keys homed in the segment, updated under the lock and read by get_n_keys()
+    // without it.
+    size_t n_keys;
+    size_t n_rehashed_keys;
+    // Set while an operation which has seen the current global version holds the lock of the
+    // segment, which is the lower one of its pair.
+    bool is_in_use;
+    segment() : n_keys(0), n_rehashed_keys(0), is_in_use(false) {}
+  };
+
+  first_touch_array<segment> segments;
+
+  // Odd while a global operation is running, and incremented at its start and end.
+  size_t global_version;
+
+  L global_lock;
+};
+
+template <class L>
+bool segment_locks<L>::lock_pair(
+    const size_t segment_id_1, const size_t segment_id_2, const size_t version) {
+  segment& first = segments[std::min(segment_id_1, segment_id_2)];
+  first.lock.lock();
+  if (segment_id_2 != segment_id_1) segments[std::max(segment_id_1, segment_id_2)].lock.lock();
+  // The flag is set before the version is read, and a global operation increments the version
+  // before reading the flag, so either the operation sees the new version or the global operation
+  // sees the flag.
+  __atomic_store_n(&first.is_in_use, true, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&global_version, __ATOMIC_SEQ_CST) == version) return true;
+  __atomic_store_n(&first.is_in_use, false, __ATOMIC_RELAXED);
+  unlock_pair(segment_id_1, segment_id_2);
+  return false;
+}
+
+template <class L>
+void segment_locks<L>::unlock_pair(const size_t segment_id_1, const size_t segment_id_2) {
+  segment& first = segments[std::min(segment_id_1, segment_id_2)];
+  __atomic_store_n(&first.is_in_use, false, __ATOMIC_RELEASE);
+  if (segment_id_2 != segment_id_1) segments[std::max(segment_id_1, segment_id_2)].lock.unlock();
+  first.lock.unlock();
+}
+
+template <class L>
+void segment_locks<L>::lock_rehashing_pair(const size_t segment_id_1, const size_t segment_id_2) {
+  segments[std::min(segment_id_1, segment_id_2)].rehashing_lock.lock();
+  if (segment_id_2 != segment_id_1) {
+    segments[std::max(segment_id_1, segment_id_2)].rehashing_lock.lock();
+  }
+}
+
+template <class L>
+void segment_locks<L>::unlock_rehashing_pair(
+    const size_t segment_id_1, const size_t segment_id_2) {
+  if (segment_id_2 != segment_id_1) {
+    segments[std::max(segment_id_1, segment_id_2)].rehashing_lock.unlock();
+  }
+  segments[std::min(segment_id_1, segment_id_2)].rehashing_lock.unlock();
+}
+
+template <class L>
+void segment_locks<L>::begin_global_operation() {
+  // The operations in flight all finish in parallel, so the wait lasts as long as the longest of
+  // them, and no segment lock is taken.
+  global_lock.lock();
+  __atomic_store_n(&global_version, global_version + 1, __ATOMIC_SEQ_CST);
+  for (size_t i = 0; i < segments.size(); i++) {
+    while (__atomic_load_n(&segments[i].is_in_use, __ATOMIC_ACQUIRE)) sched_yield();
+  }
+}
+
+template <class L>
+size_t segment_locks<L>::get_n_keys() const {
+  size_t n_keys = 0;
+  for (size_t i = 0; i < segments.size(); i++) {
+    n_keys += __atomic_load_n(&segments[i].n_keys, __ATOMIC_RELAXED);
+  }
+  return n_keys;
+}
+
+}  // namespace omp_open_addressing
+
+#endif